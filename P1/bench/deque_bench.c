@@ -0,0 +1,210 @@
+/**
+ * @file deque_bench.c
+ *
+ * @brief Microbenchmark for the deques generated by @a IMPLEMENT_DEQUE()
+ *
+ * Every workload is run for an element type the size of a char and one the
+ * size of a small struct. Build and run it with `make bench`. The short lived
+ * workload is also run for the deques of @a IMPLEMENT_SMALL_DEQUE().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "deque.h"
+
+/** @brief A struct sized element */
+typedef struct Point {
+  double x;
+  double y;
+  double z;
+  int id;
+} Point;
+
+IMPLEMENT_DEQUE_STRUCT(CharDeque, char);
+IMPLEMENT_DEQUE(CharDeque, char);
+IMPLEMENT_DEQUE_STRUCT(PointDeque, Point);
+IMPLEMENT_DEQUE(PointDeque, Point);
+IMPLEMENT_SMALL_DEQUE_STRUCT(SmallCharDeque, char, 4);
+IMPLEMENT_SMALL_DEQUE(SmallCharDeque, char, 4);
+IMPLEMENT_SMALL_DEQUE_STRUCT(SmallPointDeque, Point, 4);
+IMPLEMENT_SMALL_DEQUE(SmallPointDeque, Point, 4);
+
+#define ELEMENTS 1000000
+#define ROUNDS 20
+#define QUEUE_LENGTH 1000
+#define CHUNK 40
+#define SHORT_LENGTH 3
+
+// Keeps the compiler from throwing the results away
+static volatile long __sink;
+
+static double __now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static char __make_char(int i) {
+  return (char) i;
+}
+
+static long __char_key(char c) {
+  return c;
+}
+
+static Point __make_point(int i) {
+  return (Point) { i, i, i, i };
+}
+
+static long __point_key(Point p) {
+  return p.id;
+}
+
+// Build a deque from nothing with push_back and turn it into an array like
+// the string builders in the parser do
+#define BENCH_BUILD(name, struct_name, make, key)                       \
+  static double name() {                                                \
+    double start = __now();                                             \
+                                                                        \
+    for (int r = 0; r < ROUNDS; ++r) {                                  \
+      struct_name deq = new_##struct_name(1);                           \
+                                                                        \
+      for (int i = 0; i < ELEMENTS; ++i)                                \
+        push_back_##struct_name(&deq, make(i));                         \
+                                                                        \
+      size_t len;                                                       \
+      __typeof__(make(0))* arr = as_array_##struct_name(&deq, &len);    \
+                                                                        \
+      __sink += key(arr[len - 1]);                                      \
+      free(arr);                                                        \
+    }                                                                   \
+                                                                        \
+    return (__now() - start) / ((double) ROUNDS * ELEMENTS);            \
+  }
+
+// Build a deque with push_front so the elements wrap around before every
+// growth and as_array has to put them back in order
+#define BENCH_WRAP(name, struct_name, make, key)                        \
+  static double name() {                                                \
+    double start = __now();                                             \
+                                                                        \
+    for (int r = 0; r < ROUNDS; ++r) {                                  \
+      struct_name deq = new_##struct_name(1);                           \
+                                                                        \
+      push_back_##struct_name(&deq, make(0));                           \
+                                                                        \
+      for (int i = 1; i < ELEMENTS; ++i)                                \
+        push_front_##struct_name(&deq, make(i));                        \
+                                                                        \
+      size_t len;                                                       \
+      __typeof__(make(0))* arr = as_array_##struct_name(&deq, &len);    \
+                                                                        \
+      __sink += key(arr[len - 1]);                                      \
+      free(arr);                                                        \
+    }                                                                   \
+                                                                        \
+    return (__now() - start) / ((double) ROUNDS * ELEMENTS);            \
+  }
+
+// Build the same deque as BENCH_BUILD in chunks with push_back_n like the
+// string builders in the parser do
+#define BENCH_BULK(name, struct_name, make, key)                        \
+  static double name() {                                                \
+    __typeof__(make(0)) chunk[CHUNK];                                   \
+                                                                        \
+    for (int i = 0; i < CHUNK; ++i)                                     \
+      chunk[i] = make(i);                                               \
+                                                                        \
+    double start = __now();                                             \
+                                                                        \
+    for (int r = 0; r < ROUNDS; ++r) {                                  \
+      struct_name deq = new_##struct_name(1);                           \
+                                                                        \
+      for (int i = 0; i < ELEMENTS; i += CHUNK)                         \
+        push_back_n_##struct_name(&deq, chunk, CHUNK);                  \
+                                                                        \
+      size_t len;                                                       \
+      __typeof__(make(0))* arr = as_array_##struct_name(&deq, &len);    \
+                                                                        \
+      __sink += key(arr[len - 1]);                                      \
+      free(arr);                                                        \
+    }                                                                   \
+                                                                        \
+    return (__now() - start) / ((double) ROUNDS * ELEMENTS);            \
+  }
+
+// Use the deque as a queue of steady length like the job queues do
+#define BENCH_QUEUE(name, struct_name, make, key)                       \
+  static double name() {                                                \
+    struct_name deq = new_##struct_name(QUEUE_LENGTH);                  \
+                                                                        \
+    for (int i = 0; i < QUEUE_LENGTH; ++i)                              \
+      push_back_##struct_name(&deq, make(i));                           \
+                                                                        \
+    double start = __now();                                             \
+                                                                        \
+    for (long i = 0; i < (long) ROUNDS * ELEMENTS; ++i) {               \
+      push_back_##struct_name(&deq, make(i));                           \
+      __sink += key(pop_front_##struct_name(&deq));                     \
+    }                                                                   \
+                                                                        \
+    double ret = (__now() - start) / ((double) ROUNDS * ELEMENTS);      \
+                                                                        \
+    destroy_##struct_name(&deq);                                        \
+                                                                        \
+    return ret;                                                         \
+  }
+
+// Create many deques that only ever hold a few elements like the process
+// queues of jobs do
+#define BENCH_SHORT(name, struct_name, make, key)                       \
+  static double name() {                                                \
+    double start = __now();                                             \
+                                                                        \
+    for (int i = 0; i < ELEMENTS; ++i) {                                \
+      struct_name deq = new_##struct_name(0);                           \
+                                                                        \
+      for (int j = 0; j < SHORT_LENGTH; ++j)                            \
+        push_front_##struct_name(&deq, make(i + j));                    \
+                                                                        \
+      __sink += key(peek_front_##struct_name(&deq));                    \
+      destroy_##struct_name(&deq);                                      \
+    }                                                                   \
+                                                                        \
+    return (__now() - start) / ELEMENTS;                                \
+  }
+
+BENCH_BUILD(__char_build, CharDeque, __make_char, __char_key)
+BENCH_BULK(__char_bulk, CharDeque, __make_char, __char_key)
+BENCH_WRAP(__char_wrap, CharDeque, __make_char, __char_key)
+BENCH_QUEUE(__char_queue, CharDeque, __make_char, __char_key)
+BENCH_BUILD(__point_build, PointDeque, __make_point, __point_key)
+BENCH_BULK(__point_bulk, PointDeque, __make_point, __point_key)
+BENCH_WRAP(__point_wrap, PointDeque, __make_point, __point_key)
+BENCH_QUEUE(__point_queue, PointDeque, __make_point, __point_key)
+BENCH_SHORT(__char_short, CharDeque, __make_char, __char_key)
+BENCH_SHORT(__point_short, PointDeque, __make_point, __point_key)
+BENCH_SHORT(__small_char_short, SmallCharDeque, __make_char, __char_key)
+BENCH_SHORT(__small_point_short, SmallPointDeque, __make_point, __point_key)
+
+int main() {
+  printf("%-30s %10s %10s\n", "workload", "char", "Point");
+  printf("%-30s %7.2f ns %7.2f ns\n", "push_back + as_array",
+         __char_build(), __point_build());
+  printf("%-30s %7.2f ns %7.2f ns\n", "push_back_n + as_array",
+         __char_bulk(), __point_bulk());
+  printf("%-30s %7.2f ns %7.2f ns\n", "push_front + as_array",
+         __char_wrap(), __point_wrap());
+  printf("%-30s %7.2f ns %7.2f ns\n", "push_back + pop_front",
+         __char_queue(), __point_queue());
+  printf("%-30s %7.2f ns %7.2f ns\n", "new + 3 push_front + destroy",
+         __char_short(), __point_short());
+  printf("%-30s %7.2f ns %7.2f ns\n", "same with a small deque",
+         __small_char_short(), __small_point_short());
+
+  return EXIT_SUCCESS;
+}
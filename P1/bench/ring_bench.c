@@ -0,0 +1,152 @@
+/**
+ * @file ring_bench.c
+ *
+ * @brief Throughput benchmark for the rings generated by ring.h
+ *
+ * Producer threads push a fixed number of elements in total while the main
+ * thread pops them. The same workload is run through a deque guarded by a
+ * mutex to show what the rings save over a lock. Build and run it with `make
+ * bench`.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "deque.h"
+#include "ring.h"
+
+#define CAPACITY 1024
+#define ELEMENTS 20000000
+#define MAX_PRODUCERS 4
+
+IMPLEMENT_SPSC_RING_STRUCT(LongSpsc, long, CAPACITY);
+IMPLEMENT_SPSC_RING(LongSpsc, long, CAPACITY);
+IMPLEMENT_MPSC_RING_STRUCT(LongMpsc, long, CAPACITY);
+IMPLEMENT_MPSC_RING(LongMpsc, long, CAPACITY);
+IMPLEMENT_DEQUE_STRUCT(LongDeque, long);
+IMPLEMENT_DEQUE(LongDeque, long);
+
+/** @brief A deque that threads take turns on */
+typedef struct LockedDeque {
+  pthread_mutex_t lock;
+  LongDeque deq;
+} LockedDeque;
+
+static LongSpsc spsc;
+static LongMpsc mpsc;
+static LockedDeque locked;
+
+// Keeps the compiler from throwing the results away
+static volatile long __sink;
+
+static double __now() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Bounded like the rings so producers cannot run far ahead
+static bool __locked_push(LockedDeque* ld, long element) {
+  bool ret = false;
+
+  pthread_mutex_lock(&ld->lock);
+
+  if (length_LongDeque(&ld->deq) < CAPACITY) {
+    push_back_LongDeque(&ld->deq, element);
+    ret = true;
+  }
+
+  pthread_mutex_unlock(&ld->lock);
+
+  return ret;
+}
+
+static bool __locked_pop(LockedDeque* ld, long* element) {
+  bool ret = false;
+
+  pthread_mutex_lock(&ld->lock);
+
+  if (!is_empty_LongDeque(&ld->deq)) {
+    *element = pop_front_LongDeque(&ld->deq);
+    ret = true;
+  }
+
+  pthread_mutex_unlock(&ld->lock);
+
+  return ret;
+}
+
+// Run a queue with a number of producer threads and the main thread as the
+// consumer. Returns nanoseconds per element.
+#define BENCH_QUEUE(name, queue, push, pop)                             \
+  static void* name##_producer(void* arg) {                             \
+    long count = (long) arg;                                            \
+                                                                        \
+    for (long i = 0; i < count; ++i) {                                  \
+      while (!push(&queue, i))                                          \
+        sched_yield();                                                  \
+    }                                                                   \
+                                                                        \
+    return NULL;                                                        \
+  }                                                                     \
+                                                                        \
+  static double name(int producers) {                                   \
+    pthread_t threads[MAX_PRODUCERS];                                   \
+    long count = ELEMENTS / producers;                                  \
+    long total = count * producers;                                     \
+    long element;                                                       \
+    long sum = 0;                                                       \
+                                                                        \
+    double start = __now();                                             \
+                                                                        \
+    for (int i = 0; i < producers; ++i)                                 \
+      pthread_create(&threads[i], NULL, name##_producer,                \
+                     (void*) count);                                    \
+                                                                        \
+    for (long i = 0; i < total; ++i) {                                  \
+      while (!pop(&queue, &element))                                    \
+        sched_yield();                                                  \
+                                                                        \
+      sum += element;                                                   \
+    }                                                                   \
+                                                                        \
+    for (int i = 0; i < producers; ++i)                                 \
+      pthread_join(threads[i], NULL);                                   \
+                                                                        \
+    __sink += sum;                                                      \
+                                                                        \
+    return (__now() - start) / total;                                   \
+  }
+
+BENCH_QUEUE(__spsc, spsc, try_push_LongSpsc, try_pop_LongSpsc)
+BENCH_QUEUE(__mpsc, mpsc, try_push_LongMpsc, try_pop_LongMpsc)
+BENCH_QUEUE(__locked, locked, __locked_push, __locked_pop)
+
+static void __report(const char* workload, double ns) {
+  printf("%-30s %7.2f ns %7.1f M/s\n", workload, ns, 1e3 / ns);
+}
+
+int main() {
+  init_LongSpsc(&spsc);
+  init_LongMpsc(&mpsc);
+  pthread_mutex_init(&locked.lock, NULL);
+  locked.deq = new_LongDeque(2 * CAPACITY);
+
+  printf("%-30s %10s %10s\n", "workload", "per elem", "throughput");
+  __report("spsc ring, 1 producer", __spsc(1));
+  __report("mpsc ring, 1 producer", __mpsc(1));
+  __report("mpsc ring, 2 producers", __mpsc(2));
+  __report("mpsc ring, 4 producers", __mpsc(4));
+  __report("mutex + deque, 1 producer", __locked(1));
+  __report("mutex + deque, 4 producers", __locked(4));
+
+  destroy_LongDeque(&locked.deq);
+  pthread_mutex_destroy(&locked.lock);
+
+  return EXIT_SUCCESS;
+}
@@ -1,3 +0,0 @@
-#include "BackgroundJobQueue.h"
-
-IMPLEMENT_DEQUE( backgroundJobQueue_t, Job);
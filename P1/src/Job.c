@@ -1,31 +1,34 @@
-
-#include <unistd.h>
 #include "Job.h"
 
-Job new_Job(){
-    Job job;
-    job.isBackground = false;
-    job.processQueue = new_jobProcessQueue_t(0);
-    for(int i = 0; i < 10; i++){
-        pipe(job.pipes[i]);
+Job* new_Job(){
+    Job* job = malloc(sizeof(Job));
+    if(job == NULL){
+        fprintf(stderr, "ERROR: Failed to allocate Job\n");
+        exit(-1);
     }
+    job->isBackground = false;
+    job->running = 0;
+    job->pgid = 0;
+    job->last_pid = -1;
+    job->status = 0;
+    job->cmd = NULL;
+    job->env = NULL;
+    job->prev = NULL;
+    job->next = NULL;
+    job->processQueue = new_jobProcessQueue_t(0);
     return job;
 }
 
 void push_process_front_to_job(Job* job,pid_t pid){
     push_front_jobProcessQueue_t(&(job->processQueue),pid);
+    job->running++;
+    //stages are started in order so the newest process is the last stage
+    job->last_pid = pid;
 }
 
 void destroy_job(Job* job){
     destroy_jobProcessQueue_t(&(job->processQueue));
-    if(job->isBackground){
-        free(job->cmd);
-    }
-}
-void destroy_job_callback(Job job)
-{
-    destroy_jobProcessQueue_t(&(job.processQueue));
-    if(job.isBackground){
-        free(job.cmd);
-    }
+    free(job->cmd);
+    release_environment(job->env);
+    free(job);
 }
@@ -2,23 +2,29 @@
 #define JOB_H
 
 #include "SingleJobQueue.h"
+#include "VariableTable.h"
 
 typedef int job_id_t;
 
 typedef struct Job
 {
   jobProcessQueue_t processQueue; //carry pids of all processes with it
-  int pipes[10][2];
+  int running; //number of processes in processQueue that have not been reaped
+  pid_t pgid; //process group of the job, 0 until the first process starts
+  pid_t last_pid; //last stage of the pipeline, -1 if it did not get a process
+  int status; //exit status of the last stage
   bool isBackground;
   job_id_t job_id;
   char* cmd;
+  Environment* env; //environment every process of the job starts with, NULL until the first one starts
+  struct Job* prev; //neighbours in the job table, ordered by job id
+  struct Job* next;
 } Job;
 
-Job new_Job();
+Job* new_Job();
 
 void push_process_front_to_job(Job* job, pid_t pid);
 
 void destroy_job(Job* job);
-void destroy_job_callback(Job job);
 
 #endif
@@ -0,0 +1,79 @@
+#include "JobTable.h"
+
+IMPLEMENT_HASH_TABLE (JobIndex, int, Job*, hash_int, equal_int);
+
+JobTable new_JobTable(){
+    JobTable table;
+    table.jobs = new_JobIndex(8);
+    table.processes = new_JobIndex(16);
+    table.first = NULL;
+    table.last = NULL;
+    return table;
+}
+
+void destroy_JobTable(JobTable* table){
+    Job* job = table->first;
+    while(job != NULL){
+        Job* next = job->next;
+        destroy_job(job);
+        job = next;
+    }
+    table->first = table->last = NULL;
+    destroy_JobIndex(&(table->jobs));
+    destroy_JobIndex(&(table->processes));
+}
+
+void insert_job(JobTable* table, Job* job){
+    insert_JobIndex(&(table->jobs), job->job_id, job);
+
+    //job ids only grow so new jobs always go to the end
+    job->next = NULL;
+    job->prev = table->last;
+    if(table->last != NULL){
+        table->last->next = job;
+    }
+    else{
+        table->first = job;
+    }
+    table->last = job;
+}
+
+void remove_job(JobTable* table, Job* job){
+    remove_JobIndex(&(table->jobs), job->job_id);
+
+    if(job->prev != NULL){
+        job->prev->next = job->next;
+    }
+    else{
+        table->first = job->next;
+    }
+    if(job->next != NULL){
+        job->next->prev = job->prev;
+    }
+    else{
+        table->last = job->prev;
+    }
+    job->prev = job->next = NULL;
+}
+
+Job* find_job(JobTable* table, job_id_t job_id){
+    Job** job = lookup_JobIndex(&(table->jobs), job_id);
+    return job != NULL ? *job : NULL;
+}
+
+void track_process(JobTable* table, Job* job, pid_t pid){
+    insert_JobIndex(&(table->processes), pid, job);
+}
+
+Job* find_process_job(JobTable* table, pid_t pid){
+    Job** job = lookup_JobIndex(&(table->processes), pid);
+    return job != NULL ? *job : NULL;
+}
+
+Job* untrack_process(JobTable* table, pid_t pid){
+    Job* job = find_process_job(table, pid);
+    if(job != NULL){
+        remove_JobIndex(&(table->processes), pid);
+    }
+    return job;
+}
@@ -0,0 +1,42 @@
+#ifndef JOB_TABLE_H
+#define JOB_TABLE_H
+
+#include "hash_table.h"
+#include "Job.h"
+
+//Declare the index used to find jobs by job id or pid
+IMPLEMENT_HASH_TABLE_STRUCT (JobIndex, int, Job*);
+PROTOTYPE_HASH_TABLE (JobIndex, int, Job*);
+
+typedef struct JobTable
+{
+  JobIndex jobs;      //job id -> background job
+  JobIndex processes; //pid -> job, for every process that has not been reaped
+  Job* first;         //background jobs in the order of their job ids
+  Job* last;
+} JobTable;
+
+JobTable new_JobTable();
+
+//destroys every background job in the table
+void destroy_JobTable(JobTable* table);
+
+//add a background job, job ids must be added in increasing order
+void insert_job(JobTable* table, Job* job);
+
+//remove a background job without destroying it
+void remove_job(JobTable* table, Job* job);
+
+//returns the background job with job_id or NULL
+Job* find_job(JobTable* table, job_id_t job_id);
+
+//remember that pid belongs to job until it is reaped
+void track_process(JobTable* table, Job* job, pid_t pid);
+
+//returns the job pid belongs to or NULL if pid is not tracked
+Job* find_process_job(JobTable* table, pid_t pid);
+
+//forget a reaped pid and return the job it belonged to or NULL
+Job* untrack_process(JobTable* table, pid_t pid);
+
+#endif
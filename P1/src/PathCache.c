@@ -0,0 +1,135 @@
+// strchrnul()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "PathCache.h"
+
+IMPLEMENT_HASH_TABLE (PathIndex, char*, PathEntry, hash_str, equal_str);
+
+static void destroy_path_entry(char* name, PathEntry entry){
+    free(name);
+    free(entry.path);
+}
+
+PathCache new_PathCache(){
+    PathCache cache;
+    cache.paths = new_destructable_PathIndex(32, destroy_path_entry);
+    cache.uncached = NULL;
+    cache.hits = 0;
+    cache.misses = 0;
+    return cache;
+}
+
+void destroy_PathCache(PathCache* cache){
+    destroy_PathIndex(&(cache->paths));
+    free(cache->uncached);
+    cache->uncached = NULL;
+}
+
+void clear_PathCache(PathCache* cache){
+    empty_PathIndex(&(cache->paths));
+}
+
+//check for an executable regular file
+static bool is_executable(const char* path){
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+//walk PATH the same way execvp() does and return a malloc'd path. relative
+//is set when the path came from a relative entry and so depends on the
+//current directory.
+static char* search_path(const char* name, const char* path, bool* relative){
+    char* found = NULL;
+    size_t nameLen = strlen(name);
+
+    if(path == NULL){
+        path = "/bin:/usr/bin";
+    }
+
+    while(found == NULL){
+        const char* end = strchrnul(path, ':');
+        size_t dirLen = end - path;
+        char* candidate;
+
+        //an empty entry means the current directory
+        if(dirLen == 0){
+            candidate = malloc(nameLen + 3);
+            sprintf(candidate, "./%s", name);
+        }
+        else{
+            candidate = malloc(dirLen + nameLen + 2);
+            sprintf(candidate, "%.*s/%s", (int) dirLen, path, name);
+        }
+
+        if(is_executable(candidate)){
+            found = candidate;
+            *relative = dirLen == 0 || path[0] != '/';
+        }
+        else{
+            free(candidate);
+        }
+
+        if(*end == '\0'){
+            break;
+        }
+        path = end + 1;
+    }
+
+    return found;
+}
+
+const char* resolve_path(PathCache* cache, const char* name, const char* path){
+    if(strchr(name, '/') != NULL){
+        return name;
+    }
+
+    PathEntry* entry = lookup_PathIndex(&(cache->paths), (char*) name);
+    if(entry != NULL){
+        cache->hits++;
+        entry->hits++;
+        return entry->path;
+    }
+
+    cache->misses++;
+
+    //only hits are cached so a program installed later is still found
+    bool relative = false;
+    char* found = search_path(name, path, &relative);
+    if(found == NULL){
+        return NULL;
+    }
+
+    //a relative path would run something else after a cd so it is looked up
+    //again every time, like execvp() does
+    if(relative){
+        free(cache->uncached);
+        cache->uncached = found;
+        return found;
+    }
+
+    insert_PathIndex(&(cache->paths), strdup(name), (PathEntry) { found, 0 });
+    return found;
+}
+
+void forget_path(PathCache* cache, const char* name){
+    remove_PathIndex(&(cache->paths), (char*) name);
+}
+
+static void print_path_entry(char* name, PathEntry entry){
+    printf("%4zu\t%s\n", entry.hits, entry.path);
+}
+
+void print_PathCache(PathCache* cache){
+    if(length_PathIndex(&(cache->paths)) > 0){
+        printf("hits\tcommand\n");
+        apply_PathIndex(&(cache->paths), print_path_entry);
+    }
+    printf("cache: %zu hits, %zu misses\n", cache->hits, cache->misses);
+    fflush(stdout);
+}
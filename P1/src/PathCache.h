@@ -0,0 +1,43 @@
+#ifndef PATH_CACHE_H
+#define PATH_CACHE_H
+
+#include "hash_table.h"
+
+typedef struct PathEntry
+{
+  char* path; //absolute path the command name resolved to
+  size_t hits; //number of launches that used this entry
+} PathEntry;
+
+//Declare the index from command names to their paths
+IMPLEMENT_HASH_TABLE_STRUCT (PathIndex, char*, PathEntry);
+PROTOTYPE_HASH_TABLE (PathIndex, char*, PathEntry);
+
+typedef struct PathCache
+{
+  PathIndex paths; //command name -> entry, names and paths are owned
+  char* uncached; //last path found through a relative PATH entry, never cached
+  size_t hits; //lookups answered by the cache
+  size_t misses; //lookups that had to search PATH
+} PathCache;
+
+PathCache new_PathCache();
+
+void destroy_PathCache(PathCache* cache);
+
+//forget every cached path, the hit and miss counters are kept
+void clear_PathCache(PathCache* cache);
+
+//returns the path to execute for name or NULL if it is not in path, the
+//value of PATH. names containing a '/' are returned unchanged. the result is
+//owned by the cache and only valid until the cache is changed. paths found
+//through relative PATH entries such as "." are not cached.
+const char* resolve_path(PathCache* cache, const char* name, const char* path);
+
+//forget the path of a single command, for example after it went stale
+void forget_path(PathCache* cache, const char* name);
+
+//print every entry with its hits followed by the overall counters
+void print_PathCache(PathCache* cache);
+
+#endif
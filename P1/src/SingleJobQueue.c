@@ -1,3 +1,3 @@
 #include "SingleJobQueue.h"
 
-IMPLEMENT_DEQUE (jobProcessQueue_t, pid_t);
+IMPLEMENT_SMALL_DEQUE (jobProcessQueue_t, pid_t, 4);
@@ -5,9 +5,9 @@
 
 
 /*
- * Declare the queue
+ * Declare the queue. Up to three pids are kept inside the Job itself
  */
-IMPLEMENT_DEQUE_STRUCT (jobProcessQueue_t, pid_t);
+IMPLEMENT_SMALL_DEQUE_STRUCT (jobProcessQueue_t, pid_t, 4);
 
 /*
  * Create a queue for storing pids
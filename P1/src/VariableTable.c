@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "VariableTable.h"
+
+IMPLEMENT_HASH_TABLE (VariableIndex, char*, Variable, hash_str, equal_str);
+
+static void destroy_variable(char* name, Variable var){
+    free(name);
+    free(var.value);
+}
+
+//build the NAME=value string stored in the environment
+static char* make_env_string(const char* name, const char* value){
+    size_t nameLen = strlen(name);
+    size_t valueLen = strlen(value);
+    char* str = malloc(nameLen + valueLen + 2);
+
+    if(str == NULL){
+        fprintf(stderr, "ERROR: Failed to allocate environment variable\n");
+        exit(-1);
+    }
+
+    memcpy(str, name, nameLen);
+    str[nameLen] = '=';
+    memcpy(str + nameLen + 1, value, valueLen + 1);
+    return str;
+}
+
+static Environment* new_Environment(size_t capacity){
+    Environment* env = malloc(sizeof(Environment));
+
+    if(env == NULL || (env->vars = malloc(capacity * sizeof(char*))) == NULL){
+        fprintf(stderr, "ERROR: Failed to allocate environment\n");
+        exit(-1);
+    }
+
+    env->vars[0] = NULL;
+    env->length = 0;
+    env->capacity = capacity;
+    env->refs = 1;
+    return env;
+}
+
+//add a string to the end of the environment and return its slot
+static size_t append_env_string(Environment* env, char* str){
+    if(env->length + 1 == env->capacity){
+        env->capacity *= 2;
+        env->vars = realloc(env->vars, env->capacity * sizeof(char*));
+
+        if(env->vars == NULL){
+            fprintf(stderr, "ERROR: Failed to allocate environment\n");
+            exit(-1);
+        }
+    }
+
+    env->vars[env->length] = str;
+    env->vars[++env->length] = NULL;
+    return env->length - 1;
+}
+
+//make sure the table is the only owner of its environment before changing it.
+//the copy keeps every string in the same slot.
+static Environment* own_environment(VariableTable* table){
+    Environment* env = table->env;
+
+    if(env->refs == 1){
+        return env;
+    }
+
+    Environment* copy = new_Environment(env->capacity);
+
+    for(size_t i = 0; i < env->length; i++){
+        append_env_string(copy, strdup(env->vars[i]));
+    }
+
+    release_environment(env);
+    table->env = copy;
+    return copy;
+}
+
+VariableTable new_VariableTable(char** envp){
+    VariableTable table;
+    table.vars = new_destructable_VariableIndex(64, destroy_variable);
+    table.env = new_Environment(64);
+    table.generation = 0;
+
+    for(size_t i = 0; envp != NULL && envp[i] != NULL; i++){
+        const char* equals = strchr(envp[i], '=');
+        if(equals == NULL){
+            continue;
+        }
+
+        char* name = strndup(envp[i], equals - envp[i]);
+
+        //the first definition wins like it does for getenv()
+        if(lookup_VariableIndex(&(table.vars), name) == NULL){
+            Variable var = { strdup(equals + 1), true, 0 };
+            var.slot = append_env_string(table.env, strdup(envp[i]));
+            insert_VariableIndex(&(table.vars), name, var);
+        }
+        else{
+            free(name);
+        }
+    }
+
+    return table;
+}
+
+void destroy_VariableTable(VariableTable* table){
+    destroy_VariableIndex(&(table->vars));
+    release_environment(table->env);
+    table->env = NULL;
+}
+
+const char* get_variable(VariableTable* table, const char* name){
+    Variable* var = lookup_VariableIndex(&(table->vars), (char*) name);
+    return var != NULL ? var->value : NULL;
+}
+
+void set_variable(VariableTable* table, const char* name, const char* value, bool exported){
+    Variable* var = lookup_VariableIndex(&(table->vars), (char*) name);
+
+    if(var == NULL){
+        Variable newVar = { strdup(value), false, 0 };
+        insert_VariableIndex(&(table->vars), strdup(name), newVar);
+        var = lookup_VariableIndex(&(table->vars), (char*) name);
+    }
+    else{
+        //the name is kept, only the value is replaced
+        char* oldValue = var->value;
+        var->value = strdup(value);
+        free(oldValue);
+    }
+
+    table->generation++;
+
+    if(!exported && !var->exported){
+        return;
+    }
+
+    //replace the string in its slot so the environment keeps its order
+    Environment* env = own_environment(table);
+    char* str = make_env_string(name, value);
+
+    if(var->exported){
+        free(env->vars[var->slot]);
+        env->vars[var->slot] = str;
+    }
+    else{
+        var->slot = append_env_string(env, str);
+        var->exported = true;
+    }
+}
+
+Environment* share_environment(VariableTable* table){
+    table->env->refs++;
+    return table->env;
+}
+
+void release_environment(Environment* env){
+    if(env == NULL || --env->refs > 0){
+        return;
+    }
+
+    for(size_t i = 0; i < env->length; i++){
+        free(env->vars[i]);
+    }
+    free(env->vars);
+    free(env);
+}
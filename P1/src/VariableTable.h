@@ -0,0 +1,56 @@
+#ifndef VARIABLE_TABLE_H
+#define VARIABLE_TABLE_H
+
+#include <stdbool.h>
+
+#include "hash_table.h"
+
+typedef struct Variable
+{
+  char* value; //owned copy of the value
+  bool exported; //true if child processes see the variable in their environment
+  size_t slot; //index of NAME=value in the environment, only set when exported
+} Variable;
+
+//Declare the index from variable names to their values
+IMPLEMENT_HASH_TABLE_STRUCT (VariableIndex, char*, Variable);
+PROTOTYPE_HASH_TABLE (VariableIndex, char*, Variable);
+
+//the environment handed to child processes. it is shared by the table and the
+//jobs launched with it and copied by the table before a shared one is changed.
+typedef struct Environment
+{
+  char** vars; //NULL terminated NAME=value strings in the form execve() takes
+  size_t length; //number of strings in vars
+  size_t capacity; //slots allocated for vars, including the terminating NULL
+  int refs; //number of owners
+} Environment;
+
+typedef struct VariableTable
+{
+  VariableIndex vars; //name -> variable, names are owned and kept until the table is destroyed
+  Environment* env; //exported variables
+  unsigned long generation; //incremented every time a variable is set
+} VariableTable;
+
+//create a table holding every variable in envp as an exported variable
+VariableTable new_VariableTable(char** envp);
+
+void destroy_VariableTable(VariableTable* table);
+
+//returns the value of name or NULL if it is not set. the result is owned by
+//the table and only valid until name is set again.
+const char* get_variable(VariableTable* table, const char* name);
+
+//set name to a copy of value. exported variables are also written to the
+//environment. a variable that was exported once stays exported.
+void set_variable(VariableTable* table, const char* name, const char* value, bool exported);
+
+//returns a new reference to the current environment. it does not change when
+//variables are set later and has to be given back with release_environment()
+Environment* share_environment(VariableTable* table);
+
+//drop a reference from share_environment()
+void release_environment(Environment* env);
+
+#endif
@@ -131,6 +131,41 @@ Command mk_eoc() {
   return cmd;
 }
 
+// Create HashCommand structure
+Command mk_hash_command(char** args) {
+  Command cmd;
+
+  cmd.hash = (HashCommand) {
+    HASH,
+    args
+  };
+
+  return cmd;
+}
+
+// Create ParseCacheCommand structure
+Command mk_parse_cache_command(char** args) {
+  Command cmd;
+
+  cmd.parse_cache = (ParseCacheCommand) {
+    PARSE_CACHE,
+    args
+  };
+
+  return cmd;
+}
+
+// Create SourceCommand structure
+Command mk_source_command(char** args) {
+  Command cmd;
+
+  cmd.source = (SourceCommand) {
+    SOURCE,
+    args
+  };
+
+  return cmd;
+}
 
 CommandType get_command_type(Command cmd) {
   return cmd.simple.type;
@@ -205,6 +240,18 @@ static void __print_command(Command cmd) {
     __print_simple_cmd("EXIT");
     break;
 
+  case HASH:
+    __print_simple_cmd("HASH");
+    break;
+
+  case PARSE_CACHE:
+    __print_simple_cmd("PARSE_CACHE");
+    break;
+
+  case SOURCE:
+    __print_simple_cmd("SOURCE");
+    break;
+
   case EOC:
     printf("--- EOC ---");
     break;
@@ -69,7 +69,10 @@ typedef enum CommandType {
   CD,
   PWD,
   JOBS,
-  EXIT
+  EXIT,
+  HASH,
+  PARSE_CACHE,
+  SOURCE
 } CommandType;
 
 // Command Structures
@@ -130,7 +133,8 @@ typedef struct ExportCommand {
  */
 typedef struct CDCommand {
   CommandType type; /**< Type of command */
-  char* dir;        /**< Path to the directory we wish to change to */
+  char* dir;        /**< Path to the directory we wish to change to or NULL
+                     * for $HOME. It is resolved when the command runs. */
 } CDCommand;
 
 /**
@@ -174,6 +178,36 @@ typedef SimpleCommand ExitCommand;
  */
 typedef SimpleCommand EOCCommand;
 
+/**
+ * @brief Alias for @a GenericCommand to denote a command to list, clear or
+ * fill the command path cache
+ *
+ * @note The args array holds the arguments following `hash`
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand HashCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command to show or clear the
+ * parsed line cache
+ *
+ * @note The args array holds the arguments following `parsecache`
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand ParseCacheCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command to run a script in
+ * the current shell
+ *
+ * @note The args array holds the arguments following `source`
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand SourceCommand;
+
 /**
  * @brief Make all command types the same size and interchangeable
  *
@@ -183,7 +217,7 @@ typedef SimpleCommand EOCCommand;
  *
  * @sa get_command_type, SimpleCommand, GenericCommand, EchoCommand,
  * ExportCommand, CDCommand, KillCommand, PWDCommand, JobsCommand, ExitCommand,
- * EOCCommand
+ * EOCCommand, HashCommand, ParseCacheCommand, SourceCommand
  */
 typedef union Command {
   SimpleCommand simple;   /**< Read structure as a @a SimpleCommand */
@@ -196,6 +230,10 @@ typedef union Command {
   JobsCommand jobs;       /**< Read structure as a @a JobsCommand */
   ExitCommand exit;       /**< Read structure as a @a ExitCommand */
   EOCCommand eoc;         /**< Read structure as a @a EOCCommand */
+  HashCommand hash;       /**< Read structure as a @a HashCommand */
+  ParseCacheCommand parse_cache; /**< Read structure as a @a
+                                  * ParseCacheCommand */
+  SourceCommand source;   /**< Read structure as a @a SourceCommand */
 } Command;
 
 /**
@@ -293,7 +331,7 @@ Command mk_export_command(char* env_var, char* val);
 /**
  * @brief Create a @a CDCommand structure and return a copy
  *
- * @param dir Path to the directory we wish to change to
+ * @param dir Path to the directory we wish to change to or NULL for $HOME
  *
  * @return Copy of constructed CDCommand as a @a Command
  *
@@ -350,6 +388,39 @@ Command mk_exit_command();
  */
 Command mk_eoc();
 
+/**
+ * @brief Create a @a HashCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of the arguments following `hash`
+ *
+ * @return Copy of constructed HashCommand as a @a Command
+ *
+ * @sa Command, HashCommand
+ */
+Command mk_hash_command(char** args);
+
+/**
+ * @brief Create a @a ParseCacheCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of the arguments following `parsecache`
+ *
+ * @return Copy of constructed ParseCacheCommand as a @a Command
+ *
+ * @sa Command, ParseCacheCommand
+ */
+Command mk_parse_cache_command(char** args);
+
+/**
+ * @brief Create a @a SourceCommand structure and return a copy
+ *
+ * @param args A NULL terminated array of the arguments following `source`
+ *
+ * @return Copy of constructed SourceCommand as a @a Command
+ *
+ * @sa Command, SourceCommand
+ */
+Command mk_source_command(char** args);
+
 /**
  * @brief Get the type of the command
  *
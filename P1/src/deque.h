@@ -11,6 +11,74 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Round a requested deque capacity up to a power of two
+ *
+ * Deques keep a power of two capacity so a position wraps around with a mask
+ * rather than a division.
+ *
+ * @param cap The requested capacity
+ *
+ * @return The smallest power of two that is at least @a cap and at least 1
+ */
+static inline size_t deque_round_capacity(size_t cap) {
+  size_t ret = 1;
+
+  while (ret < cap)
+    ret <<= 1;
+
+  return ret;
+}
+
+/**
+ * @brief The allocation function of deques generated by @a IMPLEMENT_DEQUE()
+ *
+ * Memory from malloc() is aligned for any type so @a align is not needed.
+ *
+ * @param size Size in bytes of the allocation
+ *
+ * @param align Alignment of the allocation
+ *
+ * @return The allocation or NULL if malloc() failed
+ */
+static inline void* deque_malloc(size_t size, size_t align) {
+  (void) align;
+
+  return malloc(size);
+}
+
+/**
+ * @brief The resize function of deques generated by @a IMPLEMENT_DEQUE()
+ *
+ * @param ptr An allocation from @a deque_malloc()
+ *
+ * @param old_size Size in bytes of @a ptr
+ *
+ * @param new_size Size in bytes to grow @a ptr to
+ *
+ * @param align Alignment of the allocation
+ *
+ * @return The grown allocation or NULL if realloc() failed
+ */
+static inline void* deque_realloc(void* ptr, size_t old_size, size_t new_size,
+                                  size_t align) {
+  (void) old_size;
+  (void) align;
+
+  return realloc(ptr, new_size);
+}
+
+/** @cond Doxygen_Suppress */
+#define __DEQUE_SPAN_STRUCT(struct_name, type)                          \
+  typedef struct struct_name##Span {                                    \
+    type* first;                                                        \
+    size_t first_len;                                                   \
+    type* second;                                                       \
+    size_t second_len;                                                  \
+  } struct_name##Span;
+/** @endcond Doxygen_Suppress */
 
 /**
  * @def IMPLEMENT_DEQUE_STRUCT(struct_name, type)
@@ -23,6 +91,9 @@
  * manually changed at any time. Instead use one of the generated functions from
  * the aforementioned macros.
  *
+ * A @a struct_name##Span structure is generated along with it to hold the
+ * result of @a as_span_##struct_name().
+ *
  * @param struct_name The name of the structure
  *
  * @param type The name of the type of elements stored in the @a struct_name
@@ -38,7 +109,43 @@
     size_t back;                                                        \
                                                                         \
     void (*destructor)(type);                                           \
-  } struct_name;
+  } struct_name;                                                        \
+                                                                        \
+  __DEQUE_SPAN_STRUCT(struct_name, type)
+
+/**
+ * @def IMPLEMENT_SMALL_DEQUE_STRUCT(struct_name, type, n)
+ *
+ * @brief Generates a structure for use with Double Ended Queues that keeps up
+ * to @a n - 1 elements inside the structure itself.
+ *
+ * The elements only move to memory from the allocator once the deque outgrows
+ * its inline storage, so short lived deques that stay small never allocate.
+ * Use it with @a IMPLEMENT_SMALL_DEQUE() or @a
+ * IMPLEMENT_SMALL_DEQUE_MEMORY_POOL() given the same @a n.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The inline capacity. This must be a power of two and at least 2.
+ *
+ * @sa IMPLEMENT_DEQUE_STRUCT(), PROTOTYPE_DEQUE()
+ */
+#define IMPLEMENT_SMALL_DEQUE_STRUCT(struct_name, type, n)              \
+  typedef struct struct_name {                                          \
+    type* data; /* NULL while the elements are in small */              \
+    size_t cap;                                                         \
+    size_t front;                                                       \
+    size_t back;                                                        \
+                                                                        \
+    void (*destructor)(type);                                           \
+                                                                        \
+    type small[n];                                                      \
+  } struct_name;                                                        \
+                                                                        \
+  __DEQUE_SPAN_STRUCT(struct_name, type)
 
 /**
  * @def PROTOTYPE_DEQUE(struct_name, type)
@@ -65,9 +172,12 @@
   bool is_empty_##struct_name(struct_name*);                            \
   size_t length_##struct_name(struct_name*);                            \
   type* as_array_##struct_name(struct_name*, size_t*);                  \
+  struct_name##Span as_span_##struct_name(struct_name*);                \
   void apply_##struct_name(struct_name*, void (*)(type));               \
   void push_front_##struct_name(struct_name*, type);                    \
   void push_back_##struct_name(struct_name*, type);                     \
+  void reserve_##struct_name(struct_name*, size_t);                     \
+  void push_back_n_##struct_name(struct_name*, type const*, size_t);    \
   type pop_front_##struct_name(struct_name*);                           \
   type pop_back_##struct_name(struct_name*);                            \
   type peek_front_##struct_name(struct_name*);                          \
@@ -77,71 +187,93 @@
   void update_and_destroy_front_##struct_name(struct_name*, type);      \
   void update_and_destroy_back_##struct_name(struct_name*, type);
 
-/**
- * @def IMPLEMENT_DEQUE(struct_name, type)
- *
- * @brief Generates a @a malloc based set of functions for use with a structure
- * generated by @a IMPLEMENT_DEQUE_STRUCT()
- *
- * @param struct_name The name of the structure
- *
- * @param type The name of the type of elements stored in the @a struct_name
- * structure
- *
- * @sa IMPLEMENT_DEQUE_STRUCT(), PROTOTYPE_DEQUE()
- */
-#define IMPLEMENT_DEQUE(struct_name, type)                              \
+/** @cond Doxygen_Suppress */
+#define __IMPLEMENT_DEQUE_STORAGE(struct_name, type, alloc, resize,     \
+                                  release)                              \
                                                                         \
-  void apply_##struct_name(struct_name*, void (*)(type));               \
+  static void __reallign_##struct_name(struct_name* deq) {              \
+    assert(deq != NULL);                                                \
+    assert(deq->data != NULL); /* Only alloc storage is realligned */   \
                                                                         \
-  struct_name new_##struct_name(size_t init_cap) {                      \
-    struct_name ret;                                                    \
+    if (deq->front != 0) {                                              \
+      size_t len = (deq->back - deq->front) & (deq->cap - 1);           \
+      size_t head = deq->cap - deq->front;                              \
                                                                         \
-    if (init_cap > 0)                                                   \
-      ret.cap = init_cap;                                               \
-    else                                                                \
-      ret.cap = 1;                                                      \
+      if (deq->front <= deq->back) {                                    \
+        memmove(deq->data, deq->data + deq->front, len * sizeof(type)); \
+      }                                                                 \
+      else if (head <= deq->front - deq->back) {                        \
+        /* The end run fits in the gap once the start moves up */       \
+        memmove(deq->data + head, deq->data, deq->back * sizeof(type)); \
+        memcpy(deq->data, deq->data + deq->front, head * sizeof(type)); \
+      }                                                                 \
+      else {                                                            \
+        type* old_data = deq->data;                                     \
                                                                         \
-    ret.data = (type*) malloc(ret.cap * sizeof(type));                  \
+        deq->data = (type*) alloc(deq->cap * sizeof(type),              \
+                                  _Alignof(type));                      \
                                                                         \
-    if (ret.data == NULL) {                                             \
-      fprintf(stderr, "ERROR: Failed to allocate struct_name"           \
-              " contents");                                             \
-      exit(-1);                                                         \
-    }                                                                   \
+        if (deq->data == NULL) {                                        \
+          fprintf(stderr, "ERROR: Failed to reallocate struct_name"     \
+                  " contents");                                         \
+          abort();                                                      \
+        }                                                               \
                                                                         \
-    ret.front = ret.back = 0;                                           \
-    ret.destructor = NULL;                                              \
+        memcpy(deq->data, old_data + deq->front, head * sizeof(type));  \
+        memcpy(deq->data + head, old_data, deq->back * sizeof(type));   \
+        release(old_data);                                              \
+      }                                                                 \
                                                                         \
-    return ret;                                                         \
+      deq->front = 0;                                                   \
+      deq->back = len;                                                  \
+    }                                                                   \
   }                                                                     \
                                                                         \
-  struct_name new_destructable_##struct_name(size_t init_cap,           \
-                                             void (*destructor)(type)){ \
-    struct_name ret = new_##struct_name(init_cap);                      \
-    ret.destructor = destructor;                                        \
-    return ret;                                                         \
-  }                                                                     \
+  static void __resize_##struct_name(struct_name* deq,                  \
+                                     size_t new_cap) {                  \
+    size_t old_cap = deq->cap;                                          \
                                                                         \
-  void destroy_##struct_name(struct_name* deq) {                        \
-    assert(deq != NULL);                                                \
+    deq->cap = new_cap;                                                 \
+    deq->data = (type*) resize(deq->data, old_cap * sizeof(type),       \
+                               new_cap * sizeof(type), _Alignof(type)); \
                                                                         \
-    if (deq->data == NULL)                                              \
-      return;                                                           \
+    if (deq->data == NULL) {                                            \
+      fprintf(stderr, "ERROR: Failed to reallocate struct_name"         \
+              " contents\n");                                           \
+      abort();                                                          \
+    }                                                                   \
                                                                         \
-    if (deq->destructor != NULL)                                        \
-      apply_##struct_name(deq, deq->destructor);                        \
+    /* Move the shorter run of a wrapped deque into the new space */    \
+    if (deq->back < deq->front) {                                       \
+      if (deq->back <= old_cap - deq->front) {                          \
+        memcpy(deq->data + old_cap, deq->data,                          \
+               deq->back * sizeof(type));                               \
+        deq->back += old_cap;                                           \
+      }                                                                 \
+      else {                                                            \
+        memcpy(deq->data + deq->front + new_cap - old_cap,              \
+               deq->data + deq->front,                                  \
+               (old_cap - deq->front) * sizeof(type));                  \
+        deq->front += new_cap - old_cap;                                \
+      }                                                                 \
+    }                                                                   \
+  }
+
+#define __IMPLEMENT_DEQUE_OPERATIONS(struct_name, type)                 \
                                                                         \
-    if (deq->data != NULL)                                              \
-      free(deq->data);                                                  \
+  struct_name new_##struct_name(size_t);                                \
+  void apply_##struct_name(struct_name*, void (*)(type));               \
                                                                         \
-    deq->data = NULL;                                                   \
-    deq->cap = deq->front = deq->back = 0;                              \
+  struct_name new_destructable_##struct_name(size_t init_cap,           \
+                                             void (*destructor)(type)){ \
+    struct_name ret = new_##struct_name(init_cap);                      \
+    ret.destructor = destructor;                                        \
+    return ret;                                                         \
   }                                                                     \
                                                                         \
   void empty_##struct_name(struct_name* deq) {                          \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
                                                                         \
     if (deq->destructor != NULL)                                        \
       apply_##struct_name(deq, deq->destructor);                        \
@@ -151,96 +283,47 @@
                                                                         \
   bool is_empty_##struct_name(struct_name* deq) {                       \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     return deq->front == deq->back;                                     \
   }                                                                     \
                                                                         \
   size_t length_##struct_name(struct_name* deq) {                       \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    return (deq->back - deq->front + deq->cap) % deq->cap;              \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
+    return (deq->back - deq->front) & (deq->cap - 1);                   \
   }                                                                     \
                                                                         \
-  static void __reallign_##struct_name(struct_name* deq) {              \
+  struct_name##Span as_span_##struct_name(struct_name* deq) {           \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
                                                                         \
-    if (deq->front != 0) {                                              \
-      type* old_data = deq->data;                                       \
-      size_t len = length_##struct_name(deq);                           \
+    type* data = __items_##struct_name(deq);                            \
                                                                         \
-      deq->data = (type*) malloc(deq->cap * sizeof(type));              \
-                                                                        \
-      if (deq->data == NULL) {                                          \
-        fprintf(stderr, "ERROR: Failed to reallocate struct_name"       \
-                " contents");                                           \
-        abort();                                                        \
-      }                                                                 \
-                                                                        \
-      size_t i;                                                         \
-                                                                        \
-      for (i = 0; i < len; ++i)                                         \
-        deq->data[i] = old_data[(deq->front + i) % deq->cap];           \
-                                                                        \
-      free(old_data);                                                   \
-                                                                        \
-      deq->front = 0;                                                   \
-      deq->back = i;                                                    \
-    }                                                                   \
-  }                                                                     \
-                                                                        \
-  type* as_array_##struct_name(struct_name* deq, size_t* len) {         \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-                                                                        \
-    __reallign_##struct_name(deq);                                      \
-                                                                        \
-    type* ret = deq->data;                                              \
-                                                                        \
-    if (len != NULL)                                                    \
-      *len = length_##struct_name(deq);                                 \
-                                                                        \
-    deq->data = NULL;                                                   \
-    deq->cap = deq->front = deq->back = 0;                              \
+    if (deq->front <= deq->back)                                        \
+      return (struct_name##Span) { data + deq->front,                   \
+                                   deq->back - deq->front,              \
+                                   data, 0 };                           \
                                                                         \
-    return ret;                                                         \
+    return (struct_name##Span) { data + deq->front,                     \
+                                 deq->cap - deq->front,                 \
+                                 data, deq->back };                     \
   }                                                                     \
                                                                         \
   void apply_##struct_name(struct_name* deq, void (*func)(type)) {      \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
                                                                         \
-    size_t len = length_##struct_name(deq);                             \
+    type* data = __items_##struct_name(deq);                            \
+    size_t mask = deq->cap - 1;                                         \
                                                                         \
-    for (size_t i = 0; i < len; ++i) {                                  \
-      func(deq->data[(deq->front + i) % deq->cap]);                     \
+    for (size_t i = deq->front; i != deq->back; i = (i + 1) & mask) {   \
+      func(data[i]);                                                    \
     }                                                                   \
   }                                                                     \
                                                                         \
-  static void __on_push_##struct_name(struct_name* deq) {               \
-    if (deq->front == (deq->back + 1) % deq->cap) {                     \
-      type* old_data = deq->data;                                       \
-      size_t old_cap = deq->cap;                                        \
-                                                                        \
-      deq->cap = 2 * deq->cap;                                          \
-      deq->data = (type*) malloc(deq->cap * sizeof(type));              \
-                                                                        \
-      if (deq->data == NULL) {                                          \
-        fprintf(stderr, "ERROR: Failed to reallocate struct_name"       \
-                " contents\n");                                         \
-        abort();                                                        \
-      }                                                                 \
-                                                                        \
-      size_t i;                                                         \
-                                                                        \
-      for (i = 0; i < old_cap - 1; ++i)                                 \
-        deq->data[i] = old_data[(deq->front + i) % old_cap];            \
-                                                                        \
-      free(old_data);                                                   \
-                                                                        \
-      deq->front = 0;                                                   \
-      deq->back = i;                                                    \
-    }                                                                   \
+  static inline void __on_push_##struct_name(struct_name* deq) {        \
+    if (deq->front == ((deq->back + 1) & (deq->cap - 1)))               \
+      __grow_##struct_name(deq, 2 * deq->cap);                          \
   }                                                                     \
                                                                         \
   static void __on_pop_##struct_name(struct_name* deq) {                \
@@ -253,92 +336,381 @@
                                                                         \
   void push_front_##struct_name(struct_name* deq, type element) {       \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     __on_push_##struct_name(deq);                                       \
-    deq->front = (deq->front + deq->cap - 1) % deq->cap;                \
-    deq->data[deq->front] = element;                                    \
+    deq->front = (deq->front - 1) & (deq->cap - 1);                     \
+    __items_##struct_name(deq)[deq->front] = element;                   \
   }                                                                     \
                                                                         \
   void push_back_##struct_name(struct_name* deq, type element) {        \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     __on_push_##struct_name(deq);                                       \
-    deq->data[deq->back] = element;                                     \
-    deq->back = (deq->back + 1) % deq->cap;                             \
+    __items_##struct_name(deq)[deq->back] = element;                    \
+    deq->back = (deq->back + 1) & (deq->cap - 1);                       \
+  }                                                                     \
+                                                                        \
+  void reserve_##struct_name(struct_name* deq, size_t count) {          \
+    assert(deq != NULL);                                                \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
+                                                                        \
+    /* A slot stays free to tell a full deque from an empty one */      \
+    size_t need = length_##struct_name(deq) + count + 1;                \
+                                                                        \
+    if (need > deq->cap)                                                \
+      __grow_##struct_name(deq, deque_round_capacity(need));            \
+  }                                                                     \
+                                                                        \
+  void push_back_n_##struct_name(struct_name* deq,                      \
+                                 type const* elements, size_t count) {  \
+    assert(deq != NULL);                                                \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
+    assert(elements != NULL || count == 0);                             \
+                                                                        \
+    reserve_##struct_name(deq, count);                                  \
+                                                                        \
+    type* data = __items_##struct_name(deq);                            \
+    size_t first = deq->cap - deq->back;                                \
+                                                                        \
+    if (first > count)                                                  \
+      first = count;                                                    \
+                                                                        \
+    /* The new elements may wrap around the end of the storage */       \
+    memcpy(data + deq->back, elements, first * sizeof(type));           \
+    memcpy(data, elements + first, (count - first) * sizeof(type));     \
+    deq->back = (deq->back + count) & (deq->cap - 1);                   \
   }                                                                     \
                                                                         \
   type pop_front_##struct_name(struct_name* deq) {                      \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     __on_pop_##struct_name(deq);                                        \
     size_t old_front = deq->front;                                      \
-    deq->front = (deq->front + 1) % deq->cap;                           \
-    return deq->data[old_front];                                        \
+    deq->front = (deq->front + 1) & (deq->cap - 1);                     \
+    return __items_##struct_name(deq)[old_front];                       \
   }                                                                     \
                                                                         \
   type pop_back_##struct_name(struct_name* deq) {                       \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     __on_pop_##struct_name(deq);                                        \
-    deq->back = (deq->back + deq->cap - 1) % deq->cap;                  \
-    return deq->data[deq->back];                                        \
+    deq->back = (deq->back - 1) & (deq->cap - 1);                       \
+    return __items_##struct_name(deq)[deq->back];                       \
   }                                                                     \
                                                                         \
   type peek_front_##struct_name(struct_name* deq) {                     \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
-    return deq->data[deq->front];                                       \
+    return __items_##struct_name(deq)[deq->front];                      \
   }                                                                     \
                                                                         \
   type peek_back_##struct_name(struct_name* deq) {                      \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
-    return deq->data[(deq->back + deq->cap - 1) % deq->cap];            \
+                                                                        \
+    size_t idx = (deq->back - 1) & (deq->cap - 1);                      \
+                                                                        \
+    return __items_##struct_name(deq)[idx];                             \
   }                                                                     \
                                                                         \
   void update_front_##struct_name(struct_name* deq, type element) {     \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
-    deq->data[deq->front] = element;                                    \
+    __items_##struct_name(deq)[deq->front] = element;                   \
   }                                                                     \
                                                                         \
   void update_back_##struct_name(struct_name* deq, type element) {      \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
-    deq->data[(deq->back + deq->cap - 1) % deq->cap] = element;         \
+                                                                        \
+    size_t idx = (deq->back - 1) & (deq->cap - 1);                      \
+                                                                        \
+    __items_##struct_name(deq)[idx] = element;                          \
   }                                                                     \
                                                                         \
   void update_and_destroy_front_##struct_name(struct_name* deq,         \
                                               type element) {           \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
                                                                         \
+    type* data = __items_##struct_name(deq);                            \
     size_t idx = deq->front;                                            \
                                                                         \
     if (deq->destructor != NULL)                                        \
-      deq->destructor(deq->data[idx]);                                  \
+      deq->destructor(data[idx]);                                       \
                                                                         \
-    deq->data[idx] = element;                                           \
+    data[idx] = element;                                                \
   }                                                                     \
                                                                         \
   void update_and_destroy_back_##struct_name(struct_name* deq,          \
                                              type element) {            \
     assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
     assert(!is_empty_##struct_name(deq));                               \
                                                                         \
-    size_t idx = (deq->back + deq->cap - 1) % deq->cap;                 \
+    type* data = __items_##struct_name(deq);                            \
+    size_t idx = (deq->back - 1) & (deq->cap - 1);                      \
                                                                         \
     if (deq->destructor != NULL)                                        \
-      deq->destructor(deq->data[idx]);                                  \
+      deq->destructor(data[idx]);                                       \
                                                                         \
-    deq->data[idx] = element;                                           \
+    data[idx] = element;                                                \
   }
+/** @endcond Doxygen_Suppress */
+
+/**
+ * @def IMPLEMENT_DEQUE_ALLOCATOR(struct_name, type, alloc, resize, release)
+ *
+ * @brief Generates a set of functions for use with a structure generated by @a
+ * IMPLEMENT_DEQUE_STRUCT() that get their memory from the given allocator
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param alloc A function like @a deque_malloc() that allocates a number of
+ * bytes aligned to a boundary
+ *
+ * @param resize A function like @a deque_realloc() that grows an allocation
+ * from its old size to a new size and keeps its contents. The returned memory
+ * may have moved.
+ *
+ * @param release A function like free() that gives back an allocation
+ *
+ * @sa IMPLEMENT_DEQUE(), IMPLEMENT_DEQUE_MEMORY_POOL()
+ */
+#define IMPLEMENT_DEQUE_ALLOCATOR(struct_name, type, alloc, resize,     \
+                                  release)                              \
+                                                                        \
+  static inline type* __items_##struct_name(struct_name* deq) {         \
+    return deq->data;                                                   \
+  }                                                                     \
+                                                                        \
+  __IMPLEMENT_DEQUE_STORAGE(struct_name, type, alloc, resize, release)  \
+                                                                        \
+  static void __grow_##struct_name(struct_name* deq, size_t new_cap) {  \
+    __resize_##struct_name(deq, new_cap);                               \
+  }                                                                     \
+                                                                        \
+  __IMPLEMENT_DEQUE_OPERATIONS(struct_name, type)                       \
+                                                                        \
+  struct_name new_##struct_name(size_t init_cap) {                      \
+    struct_name ret;                                                    \
+                                                                        \
+    ret.cap = deque_round_capacity(init_cap);                           \
+    ret.data = (type*) alloc(ret.cap * sizeof(type), _Alignof(type));   \
+                                                                        \
+    if (ret.data == NULL) {                                             \
+      fprintf(stderr, "ERROR: Failed to allocate struct_name"           \
+              " contents");                                             \
+      exit(-1);                                                         \
+    }                                                                   \
+                                                                        \
+    ret.front = ret.back = 0;                                           \
+    ret.destructor = NULL;                                              \
+                                                                        \
+    return ret;                                                         \
+  }                                                                     \
+                                                                        \
+  void destroy_##struct_name(struct_name* deq) {                        \
+    assert(deq != NULL);                                                \
+                                                                        \
+    if (deq->cap == 0)                                                  \
+      return;                                                           \
+                                                                        \
+    if (deq->destructor != NULL)                                        \
+      apply_##struct_name(deq, deq->destructor);                        \
+                                                                        \
+    release(deq->data);                                                 \
+                                                                        \
+    deq->data = NULL;                                                   \
+    deq->cap = deq->front = deq->back = 0;                              \
+  }                                                                     \
+                                                                        \
+  type* as_array_##struct_name(struct_name* deq, size_t* len) {         \
+    assert(deq != NULL);                                                \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
+                                                                        \
+    __reallign_##struct_name(deq);                                      \
+                                                                        \
+    type* ret = deq->data;                                              \
+                                                                        \
+    if (len != NULL)                                                    \
+      *len = length_##struct_name(deq);                                 \
+                                                                        \
+    deq->data = NULL;                                                   \
+    deq->cap = deq->front = deq->back = 0;                              \
+                                                                        \
+    return ret;                                                         \
+  }
+
+/**
+ * @def IMPLEMENT_SMALL_DEQUE_ALLOCATOR(struct_name, type, n, alloc, resize, release)
+ *
+ * @brief Generates a set of functions for use with a structure generated by @a
+ * IMPLEMENT_SMALL_DEQUE_STRUCT() that get their memory from the given
+ * allocator once the inline storage is full
+ *
+ * The generated functions are the same as those of @a
+ * IMPLEMENT_DEQUE_ALLOCATOR(). @a as_array_##struct_name() always returns
+ * memory from @a alloc so the array outlives the structure.
+ *
+ * @note A deque that holds its elements inline must not be copied while
+ * something still points at its elements, such as a span from @a
+ * as_span_##struct_name().
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The inline capacity given to @a IMPLEMENT_SMALL_DEQUE_STRUCT()
+ *
+ * @param alloc A function like @a deque_malloc()
+ *
+ * @param resize A function like @a deque_realloc()
+ *
+ * @param release A function like free()
+ *
+ * @sa IMPLEMENT_SMALL_DEQUE(), IMPLEMENT_SMALL_DEQUE_MEMORY_POOL()
+ */
+#define IMPLEMENT_SMALL_DEQUE_ALLOCATOR(struct_name, type, n, alloc,    \
+                                        resize, release)                \
+                                                                        \
+  _Static_assert((n) > 1 && ((n) & ((n) - 1)) == 0,                     \
+                 "struct_name needs a power of two inline capacity");   \
+                                                                        \
+  static inline type* __items_##struct_name(struct_name* deq) {         \
+    return (deq->data != NULL) ? deq->data : deq->small;                \
+  }                                                                     \
+                                                                        \
+  __IMPLEMENT_DEQUE_STORAGE(struct_name, type, alloc, resize, release)  \
+                                                                        \
+  /* Move the elements out of the inline storage in order */            \
+  static void __spill_##struct_name(struct_name* deq, size_t new_cap) { \
+    size_t len = (deq->back - deq->front) & (deq->cap - 1);             \
+    size_t head = deq->cap - deq->front;                                \
+    type* data = (type*) alloc(new_cap * sizeof(type), _Alignof(type)); \
+                                                                        \
+    if (data == NULL) {                                                 \
+      fprintf(stderr, "ERROR: Failed to allocate struct_name"           \
+              " contents\n");                                           \
+      abort();                                                          \
+    }                                                                   \
+                                                                        \
+    if (deq->front <= deq->back)                                        \
+      head = len;                                                       \
+                                                                        \
+    memcpy(data, deq->small + deq->front, head * sizeof(type));         \
+    memcpy(data + head, deq->small, (len - head) * sizeof(type));       \
+                                                                        \
+    deq->data = data;                                                   \
+    deq->cap = new_cap;                                                 \
+    deq->front = 0;                                                     \
+    deq->back = len;                                                    \
+  }                                                                     \
+                                                                        \
+  static void __grow_##struct_name(struct_name* deq, size_t new_cap) {  \
+    if (deq->data != NULL)                                              \
+      __resize_##struct_name(deq, new_cap);                             \
+    else                                                                \
+      __spill_##struct_name(deq, new_cap);                              \
+  }                                                                     \
+                                                                        \
+  __IMPLEMENT_DEQUE_OPERATIONS(struct_name, type)                       \
+                                                                        \
+  struct_name new_##struct_name(size_t init_cap) {                      \
+    struct_name ret;                                                    \
+                                                                        \
+    ret.data = NULL;                                                    \
+    ret.cap = (n);                                                      \
+    ret.front = ret.back = 0;                                           \
+    ret.destructor = NULL;                                              \
+                                                                        \
+    if (init_cap > (n))                                                 \
+      __spill_##struct_name(&ret, deque_round_capacity(init_cap));      \
+                                                                        \
+    return ret;                                                         \
+  }                                                                     \
+                                                                        \
+  void destroy_##struct_name(struct_name* deq) {                        \
+    assert(deq != NULL);                                                \
+                                                                        \
+    if (deq->cap == 0)                                                  \
+      return;                                                           \
+                                                                        \
+    if (deq->destructor != NULL)                                        \
+      apply_##struct_name(deq, deq->destructor);                        \
+                                                                        \
+    if (deq->data != NULL)                                              \
+      release(deq->data);                                               \
+                                                                        \
+    deq->data = NULL;                                                   \
+    deq->cap = deq->front = deq->back = 0;                              \
+  }                                                                     \
+                                                                        \
+  type* as_array_##struct_name(struct_name* deq, size_t* len) {         \
+    assert(deq != NULL);                                                \
+    assert(deq->cap != 0); /* Make sure the structure is valid */       \
+                                                                        \
+    /* The array outlives the deque so inline elements move out */      \
+    if (deq->data == NULL)                                              \
+      __spill_##struct_name(deq, deq->cap);                             \
+    else                                                                \
+      __reallign_##struct_name(deq);                                    \
+                                                                        \
+    type* ret = deq->data;                                              \
+                                                                        \
+    if (len != NULL)                                                    \
+      *len = length_##struct_name(deq);                                 \
+                                                                        \
+    deq->data = NULL;                                                   \
+    deq->cap = deq->front = deq->back = 0;                              \
+                                                                        \
+    return ret;                                                         \
+  }
+
+/**
+ * @def IMPLEMENT_DEQUE(struct_name, type)
+ *
+ * @brief Generates a @a malloc based set of functions for use with a structure
+ * generated by @a IMPLEMENT_DEQUE_STRUCT()
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @sa IMPLEMENT_DEQUE_STRUCT(), PROTOTYPE_DEQUE()
+ */
+#define IMPLEMENT_DEQUE(struct_name, type)                              \
+  IMPLEMENT_DEQUE_ALLOCATOR(struct_name, type, deque_malloc,            \
+                            deque_realloc, free)
+
+/**
+ * @def IMPLEMENT_SMALL_DEQUE(struct_name, type, n)
+ *
+ * @brief Generates a @a malloc based set of functions for use with a structure
+ * generated by @a IMPLEMENT_SMALL_DEQUE_STRUCT()
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The inline capacity given to @a IMPLEMENT_SMALL_DEQUE_STRUCT()
+ *
+ * @sa IMPLEMENT_SMALL_DEQUE_STRUCT(), PROTOTYPE_DEQUE()
+ */
+#define IMPLEMENT_SMALL_DEQUE(struct_name, type, n)                     \
+  IMPLEMENT_SMALL_DEQUE_ALLOCATOR(struct_name, type, n, deque_malloc,   \
+                                  deque_realloc, free)
 
 // The following deque is for example and documentation purposes only
 
@@ -361,7 +733,8 @@ typedef char Type;
 // IMPLEMENT_DEQUE_STRUCT(Example, Type);
 typedef struct Example {
   Type* data;   /**< The array holding the deque */
-  size_t cap;   /**< The current capacity of the deque */
+  size_t cap;   /**< The current capacity of the deque, always a power of two
+                 *  so positions wrap around with a mask */
   size_t front; /**< The index of the element at the front of the deque */
   size_t back;  /**< The index one greater than the last element of the queue */
 
@@ -376,12 +749,34 @@ typedef struct Example {
 } Example; /**< @brief This way you do not have to type "struct Example" each
             *  time you wish to refer to an Example structure */
 
+/**
+ * @struct ExampleSpan
+ *
+ * @brief A view of the elements of an Example deque returned by
+ * as_span_Example()
+ *
+ * The elements are the @a first run followed by the @a second run. The second
+ * run is empty unless the elements wrap around the end of the storage.
+ *
+ * @sa as_span_Example()
+ */
+// The following is the struct created by the expansion of
+// IMPLEMENT_DEQUE_STRUCT(Example, Type);
+typedef struct ExampleSpan {
+  Type* first;       /**< The elements starting at the front of the deque */
+  size_t first_len;  /**< The number of elements in @a first */
+  Type* second;      /**< The elements that wrapped around to the start of the
+                      *  storage */
+  size_t second_len; /**< The number of elements in @a second */
+} ExampleSpan;
+
 /**
  * @fn Example new_Example(size_t init_cap)
  *
  * @brief Create a new, fully initialized deque structure
  *
- * @param init_cap Initial capacity of the deque
+ * @param init_cap Initial capacity of the deque. This is rounded up to a power
+ * of two.
  *
  * @return A copy of the fully initialized struct
  *
@@ -458,6 +853,9 @@ typedef struct Example {
  * IMPLEMENT_DEQUE() macro, then the destructor is never called and you will be
  * responsible for freeing the memory of the array.
  *
+ * The array is the storage of the deque itself whenever the elements can be
+ * moved into order inside of it, so usually nothing is copied.
+ *
  * @param deq in A pointer to the deque to extract an array from
  *
  * @param[out] len A pointer to an size_t value. This value will be set to the
@@ -469,6 +867,20 @@ typedef struct Example {
  *
  * @sa Example, Type
  */
+/**
+ * @fn ExampleSpan as_span_Example(Example* deq)
+ *
+ * @brief Look at the elements of the deque in place
+ *
+ * Unlike as_array_Example() the deque is left as it is and nothing is copied.
+ * The span is only good until the deque is next changed.
+ *
+ * @param deq A pointer to the deque to look at
+ *
+ * @return The elements of the deque in at most two runs
+ *
+ * @sa Example, ExampleSpan
+ */
 /**
  * @fn void apply_Example(Example* deq, void (*func)(Type))
  *
@@ -506,6 +918,34 @@ typedef struct Example {
  *
  * @sa Example, Type
  */
+/**
+ * @fn void reserve_Example(Example* deq, size_t count)
+ *
+ * @brief Make room for more elements so they can be added without growing the
+ * deque again
+ *
+ * @param deq A pointer to the deque to make room in
+ *
+ * @param count The number of elements to make room for on top of the ones
+ * already in the deque
+ *
+ * @sa Example
+ */
+/**
+ * @fn void push_back_n_Example(Example* deq, const Type* elements, size_t count)
+ *
+ * @brief Insert an array of elements to the back of the deque
+ *
+ * The deque grows at most once and the elements are copied with memcpy.
+ *
+ * @param deq A pointer to the deque to insert the elements
+ *
+ * @param elements The elements to copy into the deque
+ *
+ * @param count The number of elements in @a elements
+ *
+ * @sa Example, Type
+ */
 /**
  * @fn Type pop_front_Example(Example* deq)
  *
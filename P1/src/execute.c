@@ -7,15 +7,29 @@
  * @note As you add things to this file you may want to change the method signature
  */
 
+// pipe2()
+#define _GNU_SOURCE
+
 #include "execute.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
 
 #include "quash.h"
 #include "Job.h"
 #include "SingleJobQueue.h"
-#include "BackgroundJobQueue.h"
+#include "JobTable.h"
+#include "PathCache.h"
+#include "VariableTable.h"
+#include "parse_cache.h"
+#include "parsing_interface.h"
 
 // Remove this and all expansion calls to it
 /**
@@ -28,70 +42,188 @@
  * Interface Functions
  ***************************************************************************/
 
+extern char** environ;
+
 job_id_t job_id = 1;
 
+// SIGCHLD is blocked in quash and read from this descriptor instead
+static int sigchld_fd = -1;
+
+// The signal mask quash started with. Children get this mask back.
+static sigset_t child_sigmask;
+
+// Background jobs and the owners of all unreaped processes
+static JobTable jobTable;
+
+// Exit status of the last foreground job
+static int lastExitStatus = 0;
+
+// Process group of a subshell running source. Its jobs stay in it so killing
+// the subshell job reaches them. Always 0 in quash itself.
+static pid_t subshellPgid = 0;
+
+// Absolute paths of the commands found in PATH so far
+static PathCache pathCache;
+
+// Every shell variable, looked up by $VAR expansions
+static VariableTable variableTable;
+
 // Return a string containing the current working directory.
 char* get_current_directory(bool* should_free) {
   *should_free = true;
   return(getcwd(NULL, 512));
 }
 
+// Returns the value of $?
+int get_last_exit_status() {
+  return lastExitStatus;
+}
+
 // Returns the value of an environment variable env_var
 const char* lookup_env(const char* env_var) {
-  return(getenv(env_var));
+  return get_variable(&variableTable, env_var);
+}
+
+// Returns a number that changes whenever a variable is set
+unsigned long get_env_generation() {
+  return variableTable.generation;
+}
+
+// Sets an environment variable and exports it to child processes
+void write_env(const char* env_var, const char* val) {
+  set_variable(&variableTable, env_var, val, true);
+}
+
+// Start receiving SIGCHLD through a file descriptor
+void init_child_reaper() {
+  sigset_t mask;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigprocmask(SIG_BLOCK, &mask, &child_sigmask);
+
+  sigchld_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+  if (sigchld_fd < 0) {
+    perror("ERROR: Failed to watch for child processes");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Stop receiving SIGCHLD through a file descriptor
+void destroy_child_reaper() {
+  if (sigchld_fd >= 0)
+    close(sigchld_fd);
+
+  sigchld_fd = -1;
+}
+
+// Descriptor that becomes readable when a child process exits
+int child_reaper_fd() {
+  return sigchld_fd;
+}
+
+// Empty the SIGCHLD descriptor. Returns true if any signal was pending.
+static bool drain_sigchld_fd() {
+  struct signalfd_siginfo info[16];
+  bool pending = false;
+
+  while (read(sigchld_fd, info, sizeof(info)) > 0)
+    pending = true;
+
+  return pending;
+}
+
+// Turn a status from waitpid() into a shell exit status
+static int wait_status_value(int wstatus) {
+  if (WIFSIGNALED(wstatus))
+    return 128 + WTERMSIG(wstatus);
+
+  return WEXITSTATUS(wstatus);
+}
+
+// Turn the result of waitid() into a shell exit status
+static int siginfo_status_value(const siginfo_t* info) {
+  if (info->si_code == CLD_EXITED)
+    return info->si_status;
+
+  return 128 + info->si_status;
+}
+
+// Credit the exit of pid to the Job it belongs to. A background Job with no
+// running processes left is reported and removed from the job table.
+// Returns true if a background job completed.
+static bool record_exit(pid_t pid, int status) {
+  Job* job = untrack_process(&jobTable, pid);
+
+  if (job == NULL)
+    return false;
+
+  job->running--;
+
+  if (pid == job->last_pid)
+    job->status = status;
+
+  if (!job->isBackground || job->running > 0)
+    return false;
+
+  print_job_bg_complete(job->job_id, peek_front_jobProcessQueue_t(&job->processQueue), job->cmd);
+  remove_job(&jobTable, job);
+  destroy_job(job);
+
+  return true;
 }
 
 // Check the status of background jobs
-void check_jobs_bg_status() {
-  if(is_empty_backgroundJobQueue_t(&backgroundQueue)){
-      return;
-  }
-
-  int jobQueueLength = length_backgroundJobQueue_t(&backgroundQueue);
-
-  for(int i = 0; i < jobQueueLength; i++){
-      Job job;
-      jobProcessQueue_t queue;
-      int processQueue_length;
-      bool job_still_has_running_process;;
-
-      job = pop_front_backgroundJobQueue_t(&backgroundQueue);
-      queue = job.processQueue;
-      processQueue_length = length_jobProcessQueue_t(&queue);
-      job_still_has_running_process = false;
-
-      for(int j = 0; j < processQueue_length; j++){
-          pid_t returnPid;
-          int status;
-          int pid;
-
-          pid = pop_front_jobProcessQueue_t(&queue);
-          returnPid = waitpid(pid, &status, WNOHANG);
-        if (returnPid == -1){
-            // error
-        }
-        else if (returnPid == 0){
-            // child is still running
-            job_still_has_running_process = true;
-        }
-        else if (returnPid == pid){
-            // child is finished.
-        }
-        push_back_jobProcessQueue_t(&queue,pid);
-      }
+bool check_jobs_bg_status() {
+  bool completed = false;
+  int wstatus;
+  pid_t pid;
 
-      if( job_still_has_running_process )
-      {
-        // re-add it to the queue
-        push_back_backgroundJobQueue_t(&backgroundQueue, job);
-      }
-      else
-      {
-        // don't add it back, print message
-        print_job_bg_complete(job.job_id, peek_front_jobProcessQueue_t(&job.processQueue), job.cmd);
-        destroy_job(&job);
-      }
-  } //end for job_queue_length
+  // Without a pending SIGCHLD there is nothing to reap. This keeps the cost
+  // of a check constant no matter how many jobs are running.
+  if (!drain_sigchld_fd())
+    return false;
+
+  while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0)
+    completed |= record_exit(pid, wait_status_value(wstatus));
+
+  return completed;
+}
+
+// Block until at least one child process exits and handle every exit. Input
+// that arrives in the meantime is parsed ahead.
+static void wait_for_child_exit() {
+  parse_ahead();
+
+  struct pollfd fds[2] = {
+    { sigchld_fd, POLLIN, 0 },
+    { parse_ahead_fd(), POLLIN, 0 }
+  };
+
+  while (poll(fds, 2, -1) < 0 && errno == EINTR)
+    continue;
+
+  check_jobs_bg_status();
+}
+
+// Wait for every process of a foreground job. The processes of its group are
+// reaped in whatever order they exit. Background jobs that finish in the
+// meantime are still reported right away.
+static void wait_for_job(Job* job) {
+  while (job->running > 0) {
+    siginfo_t info;
+
+    info.si_pid = 0;
+
+    if (waitid(P_PGID, job->pgid, &info, WEXITED | WNOHANG) == 0 &&
+        info.si_pid != 0) {
+      record_exit(info.si_pid, siginfo_status_value(&info));
+      continue;
+    }
+
+    wait_for_child_exit();
+  }
 }
 
 // Prints the job id number, the process id of the first process belonging to
@@ -122,10 +254,13 @@ void run_generic(GenericCommand cmd) {
   // Execute a program with a list of arguments. The `args` array is a NULL
   // terminated (last string is always NULL) list of strings. The first element
   // in the array is the executable
-  char* exec = cmd.args[0];
+  const char* exec = resolve_path(&pathCache, cmd.args[0], lookup_env("PATH"));
   char** args = cmd.args;
 
-  execvp(exec, args);
+  if (exec == NULL)
+    errno = ENOENT;
+  else
+    execve(exec, args, variableTable.env->vars);
 
   perror("ERROR: Failed to execute program");
 }
@@ -145,62 +280,83 @@ void run_echo(EchoCommand cmd) {
 }
 
 // Sets an environment variable
-void run_export(ExportCommand cmd) {
+int run_export(ExportCommand cmd) {
   // Write an environment variable
   const char* env_var = cmd.env_var;
   const char* val = cmd.val;
 
-  setenv(env_var, val, 1);
+  write_env(env_var, val);
+
+  // Cached paths were found with the old PATH
+  if (strcmp(env_var, "PATH") == 0)
+    clear_PathCache(&pathCache);
+
+  return 0;
 }
 
 // Changes the current working directory
-void run_cd(CDCommand cmd) {
-  // Get the directory name
-  const char* dir = cmd.dir;
+int run_cd(CDCommand cmd) {
+  // Get the directory name. It is resolved here rather than by the parser so
+  // it is relative to the directory quash is in when the command runs.
+  const char* dir = cmd.dir != NULL ? cmd.dir : lookup_env("HOME");
+  char* resolvedDir;
   char* oldDir;
   char* newDir;
 
 
   // Check if the directory is valid
-  if (dir == NULL) {
+  if (dir == NULL || (resolvedDir = realpath(dir, NULL)) == NULL) {
     perror("ERROR: Failed to resolve path");
-    return;
+    return 1;
   }
 
   oldDir = getcwd(NULL, 512);
-  chdir(dir);
+
+  if (chdir(resolvedDir) < 0) {
+    perror("ERROR: Failed to change directory");
+    free(resolvedDir);
+    free(oldDir);
+    return 1;
+  }
+
+  free(resolvedDir);
   newDir = getcwd(NULL, 512);
-  setenv("PWD", newDir, 1);
-  setenv("OLDPWD", oldDir, 1);
+  write_env("PWD", newDir);
+  write_env("OLDPWD", oldDir);
 
   //free directory strings
   free(newDir);
   free(oldDir);
+
+  return 0;
 }
 
 // Sends a signal to all processes contained in a job
-void run_kill(KillCommand cmd) {
+int run_kill(KillCommand cmd) {
   int signal = cmd.sig;
   job_id_t job_id = cmd.job;
 
-  int jobQueueLength = length_backgroundJobQueue_t(&backgroundQueue);
-  for(int i = 0; i < jobQueueLength; i++){
-      Job job = pop_front_backgroundJobQueue_t(&backgroundQueue);
-      if(job.job_id == job_id){
-          jobProcessQueue_t queue;
-          queue = job.processQueue;
-          int processQueueLength = length_jobProcessQueue_t(&queue);
-
-          for(int j = 0; j < processQueueLength; j++){
-              int pid = pop_front_jobProcessQueue_t(&queue);
-              kill(pid, signal);
-              push_back_backgroundJobQueue_t(&backgroundQueue, job);
-          }
-      }
-      else{
-          push_back_backgroundJobQueue_t(&backgroundQueue, job);
+  Job* job = find_job(&jobTable, job_id);
+  if(job == NULL){
+      fprintf(stderr, "ERROR: kill: %s: no such job\n", cmd.job_str);
+      return 1;
+  }
+
+  // A job in the table still has processes so its group is alive
+  if(killpg(job->pgid, signal) < 0){
+      perror("ERROR: Failed to send signal");
+      return 1;
+  }
+
+  // SIGKILL cannot be ignored so wait for the job to die. This way the job is
+  // reported as completed before the next command prints anything.
+  if(signal == SIGKILL){
+      while(find_job(&jobTable, job_id) != NULL){
+          wait_for_child_exit();
       }
   }
+
+  return 0;
 }
 
 
@@ -219,24 +375,76 @@ void run_pwd() {
 
 // Prints all background jobs currently in the job list to stdout
 void run_jobs() {
-  //If queue is empty then task already complete
-  if(is_empty_backgroundJobQueue_t(&backgroundQueue)){
-      return;
+  for(Job* job = jobTable.first; job != NULL; job = job->next){
+      print_job(job->job_id, peek_front_jobProcessQueue_t(&job->processQueue), job->cmd);
   }
 
-  int jobQueueLength = length_backgroundJobQueue_t(&backgroundQueue);
-
-  for(int i = 0; i < jobQueueLength; i++){
-      Job job = pop_front_backgroundJobQueue_t(&backgroundQueue);
-      print_job(job.job_id, peek_front_jobProcessQueue_t(&job.processQueue), job.cmd);
-      push_back_backgroundJobQueue_t(&backgroundQueue, job);
+  // Scripts being sourced, the one running this command last
+  for(int depth = 1; depth <= get_source_depth(); depth++){
+      printf("[source %d]\t%s\n", depth, get_source_path(depth));
   }
 
-
   // Flush the buffer before returning
   fflush(stdout);
 }
 
+// Lists, clears or fills the command path cache
+int run_hash(HashCommand cmd) {
+  char** args = cmd.args;
+  int status = 0;
+
+  if (args[0] == NULL) {
+    print_PathCache(&pathCache);
+    return 0;
+  }
+
+  for (int i = 0; args[i] != NULL; i++) {
+    if (strcmp(args[i], "-r") == 0)
+      clear_PathCache(&pathCache);
+    else if (resolve_path(&pathCache, args[i], lookup_env("PATH")) == NULL) {
+      fprintf(stderr, "ERROR: hash: %s: not found\n", args[i]);
+      status = 1;
+    }
+  }
+
+  return status;
+}
+
+// Shows or clears the cache of parsed lines
+int run_parse_cache(ParseCacheCommand cmd) {
+  char** args = cmd.args;
+  int status = 0;
+
+  for (int i = 0; args[i] != NULL; i++) {
+    if (strcmp(args[i], "-r") == 0)
+      clear_parse_cache();
+    else {
+      fprintf(stderr, "ERROR: parsecache: %s: invalid option\n", args[i]);
+      status = 1;
+    }
+  }
+
+  if (args[0] == NULL) {
+    ParseCacheStats stats = get_parse_cache_stats();
+
+    printf("parse cache: %zu hits, %zu misses, %zu/%zu lines\n", stats.hits,
+           stats.misses, stats.length, stats.capacity);
+    fflush(stdout);
+  }
+
+  return status;
+}
+
+// Runs a script in quash
+int run_source(SourceCommand cmd) {
+  if (cmd.args[0] == NULL) {
+    fprintf(stderr, "ERROR: source: filename argument required\n");
+    return 1;
+  }
+
+  return source_script(cmd.args[0]);
+}
+
 /***************************************************************************
  * Functions for command resolution and process setup
  ***************************************************************************/
@@ -250,37 +458,50 @@ void run_jobs() {
  *
  * @param cmd The Command to try to run
  *
+ * @return The exit status of the command
+ *
  * @sa Command
  */
-void child_run_command(Command cmd) {
+int child_run_command(Command cmd) {
   CommandType type = get_command_type(cmd);
 
   switch (type) {
   case GENERIC:
+    // Only returns if the program could not be run
     run_generic(cmd.generic);
-    break;
+    return 127;
 
   case ECHO:
     run_echo(cmd.echo);
-    break;
+    return 0;
 
   case PWD:
     run_pwd();
-    break;
+    return 0;
 
   case JOBS:
     run_jobs();
-    break;
+    return 0;
+
+  case HASH:
+    return run_hash(cmd.hash);
+
+  case PARSE_CACHE:
+    return run_parse_cache(cmd.parse_cache);
+
+  case SOURCE:
+    return run_source(cmd.source);
 
   case EXPORT:
   case CD:
   case KILL:
   case EXIT:
   case EOC:
-    break;
+    return 0;
 
   default:
     fprintf(stderr, "Unknown command type: %d\n", type);
+    return 1;
   }
 }
 
@@ -289,38 +510,332 @@ void child_run_command(Command cmd) {
  * function for the quash process.
  *
  * This version of the function is tailored to commands that should be run in
- * the parent process (quash).
+ * the parent process (quash). This includes the printing builtins when they do
+ * not need a process of their own.
  *
  * @param cmd The Command to try to run
  *
- * @sa Command
+ * @return The exit status of the command
+ *
+ * @sa Command, runs_in_quash
  */
-void parent_run_command(Command cmd) {
+int parent_run_command(Command cmd) {
   CommandType type = get_command_type(cmd);
 
   switch (type) {
   case EXPORT:
-    run_export(cmd.export);
-    break;
+    return run_export(cmd.export);
 
   case CD:
-    run_cd(cmd.cd);
-    break;
+    return run_cd(cmd.cd);
 
   case KILL:
-    run_kill(cmd.kill);
-    break;
+    return run_kill(cmd.kill);
 
-  case GENERIC:
   case ECHO:
+    run_echo(cmd.echo);
+    return 0;
+
   case PWD:
+    run_pwd();
+    return 0;
+
   case JOBS:
+    run_jobs();
+    return 0;
+
+  case HASH:
+    return run_hash(cmd.hash);
+
+  case PARSE_CACHE:
+    return run_parse_cache(cmd.parse_cache);
+
+  case SOURCE:
+    return run_source(cmd.source);
+
+  case GENERIC:
   case EXIT:
   case EOC:
-    break;
+    return 0;
 
   default:
     fprintf(stderr, "Unknown command type: %d\n", type);
+    return 1;
+  }
+}
+
+/**
+ * @brief Decide if the @a Command in a @a CommandHolder can be run by quash
+ * without creating a new process
+ *
+ * Builtins that change quash (cd, export and kill) are always run by quash.
+ * The printing builtins (echo, pwd, jobs, hash and parsecache) and source are
+ * only run by quash when they are neither part of a pipeline nor a background
+ * job. Otherwise source runs its script in a subshell.
+ *
+ * @param holder The CommandHolder to check
+ *
+ * @return True if the command should be run with @a run_in_quash()
+ *
+ * @sa run_in_quash, parent_run_command
+ */
+static bool runs_in_quash(CommandHolder holder) {
+  switch (get_command_holder_type(holder)) {
+  case EXPORT:
+  case CD:
+  case KILL:
+  case EXIT:
+    return true;
+
+  case SOURCE:
+  case ECHO:
+  case PWD:
+  case JOBS:
+  case HASH:
+  case PARSE_CACHE:
+    return !(holder.flags & (PIPE_IN | PIPE_OUT | BACKGROUND));
+
+  default:
+    return false;
+  }
+}
+
+// Close the pipe ends of a stage once its process has been given its copies
+static void close_stage_fds(int stage_fds[2]) {
+  if (stage_fds[0] >= 0)
+    close(stage_fds[0]);
+
+  if (stage_fds[1] >= 0)
+    close(stage_fds[1]);
+}
+
+// Point standard in and out of quash at the redirect files of a holder. The
+// replaced descriptors are stored in saved_fds so they can be put back with
+// restore_quash_fds().
+static bool redirect_quash_fds(CommandHolder holder, int saved_fds[2]) {
+  saved_fds[0] = saved_fds[1] = -1;
+
+  // Anything already buffered belongs to the original standard out
+  fflush(stdout);
+
+  if (holder.flags & REDIRECT_IN) {
+    int fd = open(holder.redirect_in, O_RDONLY);
+
+    if (fd < 0) {
+      perror("ERROR: Failed to redirect input");
+      return false;
+    }
+
+    saved_fds[0] = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+  }
+
+  if (holder.flags & REDIRECT_OUT) {
+    int oflags = O_WRONLY | O_CREAT;
+
+    oflags |= (holder.flags & REDIRECT_APPEND) ? O_APPEND : O_TRUNC;
+
+    int fd = open(holder.redirect_out, oflags, 0666);
+
+    if (fd < 0) {
+      perror("ERROR: Failed to redirect output");
+      return false;
+    }
+
+    saved_fds[1] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, STDOUT_FILENO);
+    close(fd);
+  }
+
+  return true;
+}
+
+// Undo the work of redirect_quash_fds()
+static void restore_quash_fds(int saved_fds[2]) {
+  fflush(stdout);
+
+  if (saved_fds[0] >= 0) {
+    dup2(saved_fds[0], STDIN_FILENO);
+    close(saved_fds[0]);
+  }
+
+  if (saved_fds[1] >= 0) {
+    dup2(saved_fds[1], STDOUT_FILENO);
+    close(saved_fds[1]);
+  }
+}
+
+/**
+ * @brief Runs a builtin directly in the quash process
+ *
+ * This saves a fork() and waitpid() for every builtin that does not need a
+ * process of its own. Redirects are applied to quash for the duration of the
+ * command and undone afterwards.
+ *
+ * @param holder The CommandHolder to run
+ *
+ * @param stage_fds The pipe ends this command reads from and writes to or -1
+ *
+ * @return The exit status of the command or 1 if a redirect failed
+ *
+ * @sa runs_in_quash, parent_run_command
+ */
+static int run_in_quash(CommandHolder holder, int stage_fds[2]) {
+  int saved_fds[2];
+  int status = 1;
+
+  if (redirect_quash_fds(holder, saved_fds))
+    status = parent_run_command(holder.cmd);
+
+  restore_quash_fds(saved_fds);
+  close_stage_fds(stage_fds);
+
+  return status;
+}
+
+/**
+ * @brief Launches a @a GenericCommand with posix_spawn() rather than fork()
+ *
+ * The redirects and pipes requested by the flags of the @a CommandHolder are
+ * expressed as file actions so the child never runs any quash code. Since the
+ * launch does not duplicate the address space of quash, its cost does not grow
+ * with the size of the shell. A failure to execute the program is reported by
+ * quash itself instead of by a child process.
+ *
+ * @param holder The CommandHolder holding a @a GenericCommand
+ *
+ * @param stage_fds The pipe ends this process reads from and writes to or -1
+ *
+ * @param job The Job this process belongs to
+ *
+ * @return The pid of the new process or -1 if it could not be started. The
+ * status of @a job is then set to 1 for a failed redirect and 127 for a
+ * program that could not be run.
+ *
+ * @sa create_process
+ */
+static pid_t spawn_generic(CommandHolder holder, int stage_fds[2], Job* job) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  sigset_t defaults;
+  char** args = holder.cmd.generic.args;
+  int redirect_fds[2] = { -1, -1 };
+  pid_t pid;
+  int err;
+
+  // Redirect files are opened here rather than by posix_spawn so a missing
+  // file is not mistaken for a missing program
+  if (holder.flags & REDIRECT_IN) {
+    redirect_fds[0] = open(holder.redirect_in, O_RDONLY | O_CLOEXEC);
+
+    if (redirect_fds[0] < 0) {
+      perror("ERROR: Failed to redirect input");
+      job->status = 1;
+      return -1;
+    }
+  }
+
+  if (holder.flags & REDIRECT_OUT) {
+    int oflags = O_WRONLY | O_CREAT | O_CLOEXEC;
+
+    oflags |= (holder.flags & REDIRECT_APPEND) ? O_APPEND : O_TRUNC;
+    redirect_fds[1] = open(holder.redirect_out, oflags, 0666);
+
+    if (redirect_fds[1] < 0) {
+      perror("ERROR: Failed to redirect output");
+      close_stage_fds(redirect_fds);
+      job->status = 1;
+      return -1;
+    }
+  }
+
+  posix_spawn_file_actions_init(&actions);
+
+  if (redirect_fds[0] >= 0)
+    posix_spawn_file_actions_adddup2(&actions, redirect_fds[0], STDIN_FILENO);
+
+  if (redirect_fds[1] >= 0)
+    posix_spawn_file_actions_adddup2(&actions, redirect_fds[1], STDOUT_FILENO);
+
+  // Pipe ends are close-on-exec so only the duplicates survive the exec
+  if (stage_fds[1] >= 0)
+    posix_spawn_file_actions_adddup2(&actions, stage_fds[1], STDOUT_FILENO);
+
+  if (stage_fds[0] >= 0)
+    posix_spawn_file_actions_adddup2(&actions, stage_fds[0], STDIN_FILENO);
+
+  // Children should not inherit the blocked SIGCHLD or the ignored SIGTTOU of
+  // quash. The first process of a job starts a new process group that the
+  // rest of the job joins.
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGTTOU);
+
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigmask(&attr, &child_sigmask);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  posix_spawnattr_setpgroup(&attr, job->pgid);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+                           POSIX_SPAWN_SETPGROUP);
+
+  // Every stage of a job starts with the environment of the first one. The
+  // vector is passed as is, nothing is copied for the launch.
+  if (job->env == NULL)
+    job->env = share_environment(&variableTable);
+
+  // Launch the cached path directly instead of trying every PATH entry. A
+  // cached path that has gone stale is looked up once more.
+  for (int tries = 0; tries < 2; tries++) {
+    const char* path = resolve_path(&pathCache, args[0], lookup_env("PATH"));
+
+    err = (path == NULL) ? ENOENT
+        : posix_spawn(&pid, path, &actions, &attr, args, job->env->vars);
+
+    if (err != ENOENT || path == NULL || path == args[0])
+      break;
+
+    forget_path(&pathCache, args[0]);
+  }
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  close_stage_fds(redirect_fds);
+
+  if (err != 0) {
+    fprintf(stderr, "ERROR: Failed to execute program: %s\n", strerror(err));
+    job->status = 127;
+    return -1;
+  }
+
+  return pid;
+}
+
+/**
+ * @brief Adds a newly started process to its @a Job
+ *
+ * The first process of a job becomes the leader of its process group. In an
+ * interactive session a foreground job is also given the terminal.
+ *
+ * @param holder The CommandHolder the process was started for
+ *
+ * @param job The Job the process belongs to
+ *
+ * @param pid The pid of the new process
+ */
+static void add_process_to_job(CommandHolder holder, Job* job, pid_t pid) {
+  push_process_front_to_job(job, pid);
+  track_process(&jobTable, job, pid);
+
+  if (job->pgid != 0)
+    return;
+
+  job->pgid = pid;
+
+  if (is_tty() && !(holder.flags & BACKGROUND)) {
+    tcsetpgrp(STDIN_FILENO, pid);
+
+    // The process may have been stopped reading the terminal before it got it
+    killpg(pid, SIGCONT);
   }
 }
 
@@ -332,25 +847,56 @@ void parent_run_command(Command cmd) {
  * processes running under it. This function creates a process that is part of a
  * larger job.
  *
- * @note Not all commands should be run in the child process. A few need to
- * change the quash process in some way
+ * @note Builtins that do not need a process of their own never reach this
+ * function. They are run by @a run_in_quash() instead.
  *
  * @param holder The CommandHolder to try to run
  *
+ * @param stage_fds The pipe ends this process reads from and writes to or -1
+ *
+ * @param job The Job this process belongs to
+ *
  * @sa Command CommandHolder
  */
-void create_process(CommandHolder holder, int pipeNum, Job* job) {
+void create_process(CommandHolder holder, int stage_fds[2], Job* job) {
   // Read the flags field from the parser
-  bool p_in  = holder.flags & PIPE_IN;
-  bool p_out = holder.flags & PIPE_OUT;
   bool r_in  = holder.flags & REDIRECT_IN;
   bool r_out = holder.flags & REDIRECT_OUT;
   bool r_app = holder.flags & REDIRECT_APPEND; // This can only be true if r_out
                                                // is true
 
+  // Generic commands never run quash code in the child, so skip the fork
+  if (get_command_holder_type(holder) == GENERIC) {
+    pid_t pid = spawn_generic(holder, stage_fds, job);
+
+    close_stage_fds(stage_fds);
+    if(pid > 0){
+        add_process_to_job(holder, job, pid);
+    }
+    else{
+        // spawn_generic() already set the status like other shells do
+        job->last_pid = -1;
+    }
+    return;
+  }
+
   pid_t pid = fork();
  //change so that parent is first
   if(pid == 0){
+      // A subshell waits on its own jobs the way quash does
+      bool subshell = get_command_holder_type(holder) == SOURCE;
+
+      if(subshell){
+          enter_subshell();
+      }
+      else{
+          sigprocmask(SIG_SETMASK, &child_sigmask, NULL);
+          signal(SIGTTOU, SIG_DFL);
+      }
+      setpgid(0, job->pgid);
+      if(subshell){
+          subshellPgid = getpgrp();
+      }
       if(r_in == true){
           int fileInput = open(holder.redirect_in, O_RDONLY);
           dup2(fileInput, STDIN_FILENO);
@@ -366,45 +912,54 @@ void create_process(CommandHolder holder, int pipeNum, Job* job) {
           }
           dup2(fileno(file), STDOUT_FILENO);
       }
-      if(p_out == true){
-          dup2(job->pipes[pipeNum][1], STDOUT_FILENO);
-          close(job->pipes[pipeNum][1]);
-      }
-      else{
-          close(job->pipes[pipeNum][1]);
+      if(stage_fds[1] >= 0){
+          dup2(stage_fds[1], STDOUT_FILENO);
       }
-      if(p_in == true){
-          dup2(job->pipes[pipeNum - 1][0], STDIN_FILENO);
-          close(job->pipes[pipeNum - 1][0]);
-      }
-      else if((pipeNum - 1) >= 0){
-          close(job->pipes[pipeNum-1][0]);
+      if(stage_fds[0] >= 0){
+          dup2(stage_fds[0], STDIN_FILENO);
       }
+      close_stage_fds(stage_fds);
 
-      child_run_command(holder.cmd);
+      int status = child_run_command(holder.cmd);
       destroy_job(job);
-      exit(EXIT_SUCCESS);
+      exit(status);
   }
   else{
-      if(p_out == true){
-          close(job->pipes[pipeNum][1]);
-      }
-      if(p_in == true){
-          close(job->pipes[pipeNum-1][0]);
-      }
-      push_process_front_to_job(job, pid);
-      parent_run_command(holder.cmd);
+      // Set the group here as well so it is in place whichever runs first
+      setpgid(pid, job->pgid != 0 ? job->pgid : pid);
+      close_stage_fds(stage_fds);
+      add_process_to_job(holder, job, pid);
   }
 }
 
-void initBackgroundJobQueue(void)
+void initJobTable(void)
 {
-  backgroundQueue = new_destructable_backgroundJobQueue_t(1,destroy_job_callback);
+  jobTable = new_JobTable();
 }
 
-void destroyBackgroundJobQueue(void)
+void destroyJobTable(void)
 {
-  destroy_backgroundJobQueue_t(&backgroundQueue);
+  destroy_JobTable(&jobTable);
+}
+
+void initPathCache(void)
+{
+  pathCache = new_PathCache();
+}
+
+void destroyPathCache(void)
+{
+  destroy_PathCache(&pathCache);
+}
+
+void initVariableTable(void)
+{
+  variableTable = new_VariableTable(environ);
+}
+
+void destroyVariableTable(void)
+{
+  destroy_VariableTable(&variableTable);
 }
 
 
@@ -422,30 +977,69 @@ void run_script(CommandHolder* holders) {
   }
 
   CommandType type;
-  Job job = new_Job();
+  Job* job = new_Job();
+
+  job->pgid = subshellPgid;
+  int pipe_in = -1; // Read end of the pipe feeding the next stage
 
   // Run all commands in the `holder` array
-  for (int i = 0; (type = get_command_holder_type(holders[i])) != EOC; ++i)
-    create_process(holders[i], i, &job);
+  for (int i = 0; (type = get_command_holder_type(holders[i])) != EOC; ++i) {
+    int pipe_fds[2] = { -1, -1 };
+    int stage_fds[2] = { -1, -1 };
+
+    // Only stages that write to a pipe need one. It stays open just long
+    // enough to hand both ends to their stages.
+    if ((holders[i].flags & PIPE_OUT) && pipe2(pipe_fds, O_CLOEXEC) < 0) {
+      perror("ERROR: Failed to create pipe");
+
+      if (pipe_in >= 0)
+        close(pipe_in);
+      break;
+    }
+
+    if (holders[i].flags & PIPE_IN)
+      stage_fds[0] = pipe_in;
+    else if (pipe_in >= 0)
+      close(pipe_in);
+
+    stage_fds[1] = pipe_fds[1];
+    pipe_in = pipe_fds[0];
+
+    if (runs_in_quash(holders[i])) {
+      job->status = run_in_quash(holders[i], stage_fds);
+      job->last_pid = -1;
+    }
+    else {
+      create_process(holders[i], stage_fds, job);
+    }
+  }
+
+  if (pipe_in >= 0)
+    close(pipe_in);
 
   if (!(holders[0].flags & BACKGROUND)) {
     // Not a background Job
-    // TODO: Wait for all processes under the job to complete
-    while(!is_empty_jobProcessQueue_t(&job.processQueue)){
-        int jobStatus;
-        if(waitpid(peek_back_jobProcessQueue_t(&job.processQueue), &jobStatus, 0) != -1){
-            pop_back_jobProcessQueue_t(&job.processQueue);
-        }
-    }
-    destroy_job(&job);
+    wait_for_job(job);
+
+    // Take the terminal back from the job
+    if (is_tty() && job->pgid != 0)
+      tcsetpgrp(STDIN_FILENO, getpgrp());
+
+    lastExitStatus = job->status;
+    destroy_job(job);
+  }
+  else if (is_empty_jobProcessQueue_t(&job->processQueue)) {
+    // Nothing could be started so there is no job to track
+    lastExitStatus = job->status;
+    destroy_job(job);
   }
   else {
     // A background job.
-    // TODO: Push the new job to the job queue
-    job.isBackground = true;
-    job.cmd = get_command_string();
-    job.job_id = job_id++;
-    push_back_backgroundJobQueue_t(&backgroundQueue, job);
-    print_job_bg_start(job.job_id, peek_front_jobProcessQueue_t(&job.processQueue), job.cmd);
+    lastExitStatus = 0;
+    job->isBackground = true;
+    job->cmd = get_command_string();
+    job->job_id = job_id++;
+    insert_job(&jobTable, job);
+    print_job_bg_start(job->job_id, peek_front_jobProcessQueue_t(&job->processQueue), job->cmd);
   }
 }
@@ -11,11 +11,14 @@
 #include <unistd.h>
 
 #include "command.h"
-#include "BackgroundJobQueue.h"
+#include "Job.h"
 
 /**
  * @brief Function to get environment variable values
  *
+ * Variables are kept in a hash table so this is a single lookup no matter how
+ * large the environment is.
+ *
  * @param env_var Environment variable to lookup
  *
  * @return String containing the value of the environment variable env_var
@@ -31,6 +34,16 @@ const char* lookup_env(const char* env_var);
  */
 void write_env(const char* env_var, const char* val);
 
+/**
+ * @brief Get the generation of the environment
+ *
+ * The generation changes every time a variable is set so it tells whether a
+ * line that expanded variables would still expand to the same thing.
+ *
+ * @return The current generation
+ */
+unsigned long get_env_generation();
+
 /**
  * @brief Get the real current working directory
  *
@@ -45,9 +58,45 @@ void write_env(const char* env_var, const char* val);
 char* get_current_directory(bool* should_free);
 
 /**
- * @brief Check on background jobs to see if they have exited
+ * @brief Start delivering SIGCHLD through a file descriptor
+ *
+ * SIGCHLD is blocked in quash and read from a signalfd instead. Child
+ * processes are started with the original signal mask.
+ *
+ * @sa child_reaper_fd(), check_jobs_bg_status()
+ */
+void init_child_reaper();
+
+/**
+ * @brief Close the descriptor created by @a init_child_reaper()
+ */
+void destroy_child_reaper();
+
+/**
+ * @brief Get the descriptor that becomes readable when a child process exits
+ *
+ * @return A file descriptor suitable for poll()
  */
-void check_jobs_bg_status();
+int child_reaper_fd();
+
+/**
+ * @brief Reap every child process that has exited and report background jobs
+ * that have completed
+ *
+ * This only calls waitpid() when a SIGCHLD is pending so its cost does not
+ * depend on the number of jobs.
+ *
+ * @return True if at least one background job completed
+ */
+bool check_jobs_bg_status();
+
+/**
+ * @brief Exit status of the last foreground job, the value of `$?`
+ *
+ * @return The exit status of the last stage of the pipeline or 128 plus the
+ * number of the signal that killed it
+ */
+int get_last_exit_status();
 
 /**
  * @brief Print a job to standard out
@@ -115,27 +164,33 @@ void run_echo(EchoCommand cmd);
  *
  * @param cmd An @a ExportCommand
  *
+ * @return Always 0 since setting a variable cannot fail
+ *
  * @sa ExportCommand
  */
-void run_export(ExportCommand cmd);
+int run_export(ExportCommand cmd);
 
 /**
  * @brief Run the builtin cd (change directory) command
  *
  * @param cmd An @a CDCommand
  *
+ * @return 0 or 1 if the directory could not be changed
+ *
  * @sa CDCommand
  */
-void run_cd(CDCommand cmd);
+int run_cd(CDCommand cmd);
 
 /**
  * @brief Run the builtin kill command
  *
  * @param cmd A @a KillCommand
  *
+ * @return 0 or 1 if the job does not exist or could not be signalled
+ *
  * @sa KillCommand
  */
-void run_kill(KillCommand cmd);
+int run_kill(KillCommand cmd);
 
 /**
  * @brief Run the builtin pwd (print working directory) command
@@ -147,10 +202,59 @@ void run_pwd();
 /**
  * @brief Run the builtin jobs command to show the jobs list
  *
+ * While scripts are being run by the source builtin they are listed after the
+ * jobs, outermost first.
+ *
  * @sa PWDCommand
  */
 void run_jobs();
 
+/**
+ * @brief Run the builtin hash command
+ *
+ * With no arguments the cached command paths are listed along with the hit
+ * and miss counters. `hash -r` forgets every cached path and any other
+ * arguments are looked up and added to the cache.
+ *
+ * @param cmd A @a HashCommand
+ *
+ * @return 0 or 1 if a command could not be found
+ *
+ * @sa HashCommand
+ */
+int run_hash(HashCommand cmd);
+
+/**
+ * @brief Run the builtin parsecache command
+ *
+ * With no arguments the hit and miss counters of the parsed line cache are
+ * printed. `parsecache -r` forgets every cached line.
+ *
+ * @param cmd A @a ParseCacheCommand
+ *
+ * @return 0 or 1 if an option is invalid
+ *
+ * @sa ParseCacheCommand
+ */
+int run_parse_cache(ParseCacheCommand cmd);
+
+/**
+ * @brief Run the builtin source command
+ *
+ * The script named by the first argument is run by quash itself rather than a
+ * new shell, so it can change the working directory and the variables of
+ * quash. In a pipeline or in the background it runs in a forked subshell
+ * instead and its changes are lost. Its exit status becomes the exit status
+ * of the source command.
+ *
+ * @param cmd A @a SourceCommand
+ *
+ * @return The exit status of the script
+ *
+ * @sa SourceCommand, source_script()
+ */
+int run_source(SourceCommand cmd);
+
 /**
  * @brief Common entry point for all commands
  *
@@ -163,13 +267,34 @@ void run_jobs();
  */
 void run_script(CommandHolder* holders);
 
-void initBackgroundJobQueue(void);
+/**
+*   Creates the table of background jobs
+*/
+void initJobTable(void);
+
+/**
+*   Destroys the table of background jobs and every job still in it
+*/
+void destroyJobTable(void);
 
 /**
-*   Destroys Background Job Queue
+*   Creates the cache of resolved command paths
 */
-void destroyBackgroundJobQueue(void);
+void initPathCache(void);
 
-backgroundJobQueue_t backgroundQueue;
+/**
+*   Destroys the cache of resolved command paths
+*/
+void destroyPathCache(void);
+
+/**
+*   Creates the table of shell variables from the environment quash started with
+*/
+void initVariableTable(void);
+
+/**
+*   Destroys the table of shell variables
+*/
+void destroyVariableTable(void);
 
 #endif
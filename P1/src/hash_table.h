@@ -0,0 +1,367 @@
+/**
+ * @file hash_table.h
+ *
+ * @brief Hash table generators specialized to any given key and value type.
+ *
+ * The tables use open addressing with linear probing over a power of two
+ * number of slots. Removal shifts later entries back instead of leaving
+ * tombstones, so lookups never slow down as entries come and go.
+ */
+
+#ifndef SRC_HASH_TABLE_H
+#define SRC_HASH_TABLE_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Hash function for integer keys such as job ids and pids
+ *
+ * Consecutive integers are spread across the whole table by taking the high
+ * bits of a multiplication with the golden ratio.
+ *
+ * @param key The integer to hash
+ *
+ * @return The hash of key
+ */
+static inline size_t hash_int(int key) {
+  return (size_t) (((uint64_t) (uint32_t) key * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+/**
+ * @brief Equality function for integer keys
+ *
+ * @param a First key
+ *
+ * @param b Second key
+ *
+ * @return True if the keys are equal
+ */
+static inline bool equal_int(int a, int b) {
+  return a == b;
+}
+
+/**
+ * @brief FNV-1a hash of a range of bytes
+ *
+ * @param bytes Pointer to the first byte to hash
+ *
+ * @param len Number of bytes to hash
+ *
+ * @return The hash of the byte range
+ */
+static inline size_t hash_bytes(const void* bytes, size_t len) {
+  const unsigned char* b = bytes;
+  uint64_t h = 0xcbf29ce484222325ull;
+
+  for (size_t i = 0; i < len; ++i) {
+    h ^= b[i];
+    h *= 0x100000001b3ull;
+  }
+
+  return (size_t) (h ^ (h >> 32));
+}
+
+/**
+ * @brief Hash function for NUL terminated string keys
+ *
+ * @param key The string to hash
+ *
+ * @return The hash of key
+ */
+static inline size_t hash_str(const char* key) {
+  return hash_bytes(key, strlen(key));
+}
+
+/**
+ * @brief Equality function for NUL terminated string keys
+ *
+ * @param a First key
+ *
+ * @param b Second key
+ *
+ * @return True if the strings are equal
+ */
+static inline bool equal_str(const char* a, const char* b) {
+  return strcmp(a, b) == 0;
+}
+
+/**
+ * @def IMPLEMENT_HASH_TABLE_STRUCT(struct_name, key_type, value_type)
+ *
+ * @brief Generates a structure for use with hash tables.
+ *
+ * Follow this call with either @a PROTOTYPE_HASH_TABLE() (if in a header file)
+ * or @a IMPLEMENT_HASH_TABLE() to generate the functions that correspond to
+ * this structure. The structure fields should not be manually changed at any
+ * time. Instead use one of the generated functions from the aforementioned
+ * macros.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param key_type The type of the keys stored in the @a struct_name structure
+ *
+ * @param value_type The type of the values stored in the @a struct_name
+ * structure
+ *
+ * @sa PROTOTYPE_HASH_TABLE, IMPLEMENT_HASH_TABLE
+ */
+#define IMPLEMENT_HASH_TABLE_STRUCT(struct_name, key_type, value_type)  \
+  typedef struct struct_name##Entry {                                   \
+    key_type key;                                                       \
+    value_type value;                                                   \
+    bool used;                                                          \
+  } struct_name##Entry;                                                 \
+                                                                        \
+  typedef struct struct_name {                                          \
+    struct_name##Entry* entries;                                        \
+    size_t cap;                                                         \
+    size_t len;                                                         \
+                                                                        \
+    void (*destructor)(key_type, value_type);                           \
+  } struct_name;
+
+/**
+ * @def PROTOTYPE_HASH_TABLE(struct_name, key_type, value_type)
+ *
+ * @brief Generates prototypes for functions that manipulate hash table
+ * structures.
+ *
+ * The generated functions are:
+ *   - new_##struct_name(init_cap): Create a table that can hold at least
+ *     init_cap entries before it has to grow
+ *   - new_destructable_##struct_name(init_cap, destructor): Same as above but
+ *     the destructor is called on every entry that is replaced or removed
+ *   - destroy_##struct_name(tbl): Destroy every entry and free the table
+ *   - empty_##struct_name(tbl): Destroy every entry but keep the table
+ *   - length_##struct_name(tbl): Number of entries in the table
+ *   - lookup_##struct_name(tbl, key): Pointer to the value stored for key or
+ *     NULL. The pointer is invalidated by the next insertion or removal.
+ *   - insert_##struct_name(tbl, key, value): Store value under key replacing
+ *     (and destroying) any entry that already used key
+ *   - remove_##struct_name(tbl, key): Destroy the entry for key. Returns true
+ *     if there was one.
+ *   - apply_##struct_name(tbl, func): Call func on every entry in no
+ *     particular order
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param key_type The type of the keys stored in the @a struct_name structure
+ *
+ * @param value_type The type of the values stored in the @a struct_name
+ * structure
+ *
+ * @sa IMPLEMENT_HASH_TABLE_STRUCT(), IMPLEMENT_HASH_TABLE()
+ */
+#define PROTOTYPE_HASH_TABLE(struct_name, key_type, value_type)         \
+  struct_name new_##struct_name(size_t);                                \
+  struct_name new_destructable_##struct_name(size_t,                    \
+                                             void (*)(key_type, value_type)); \
+  void destroy_##struct_name(struct_name*);                             \
+  void empty_##struct_name(struct_name*);                               \
+  size_t length_##struct_name(struct_name*);                            \
+  value_type* lookup_##struct_name(struct_name*, key_type);             \
+  void insert_##struct_name(struct_name*, key_type, value_type);        \
+  bool remove_##struct_name(struct_name*, key_type);                    \
+  void apply_##struct_name(struct_name*, void (*)(key_type, value_type));
+
+/**
+ * @def IMPLEMENT_HASH_TABLE(struct_name, key_type, value_type, hash_fn, equal_fn)
+ *
+ * @brief Generates a @a malloc based set of functions for use with a structure
+ * generated by @a IMPLEMENT_HASH_TABLE_STRUCT()
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param key_type The type of the keys stored in the @a struct_name structure
+ *
+ * @param value_type The type of the values stored in the @a struct_name
+ * structure
+ *
+ * @param hash_fn A function taking a key_type and returning a size_t hash
+ *
+ * @param equal_fn A function taking two key_type values and returning true if
+ * they are the same key
+ *
+ * @sa IMPLEMENT_HASH_TABLE_STRUCT(), PROTOTYPE_HASH_TABLE()
+ */
+#define IMPLEMENT_HASH_TABLE(struct_name, key_type, value_type, hash_fn, equal_fn) \
+                                                                        \
+  struct_name new_##struct_name(size_t init_cap) {                      \
+    struct_name ret;                                                    \
+    size_t cap = 8;                                                     \
+                                                                        \
+    /* Leave room so the table starts under its maximum load */         \
+    while (cap * 3 < init_cap * 4)                                      \
+      cap <<= 1;                                                        \
+                                                                        \
+    ret.entries = (struct_name##Entry*) calloc(cap,                     \
+                                               sizeof(struct_name##Entry)); \
+                                                                        \
+    if (ret.entries == NULL) {                                          \
+      fprintf(stderr, "ERROR: Failed to allocate struct_name"           \
+              " contents");                                             \
+      exit(-1);                                                         \
+    }                                                                   \
+                                                                        \
+    ret.cap = cap;                                                      \
+    ret.len = 0;                                                        \
+    ret.destructor = NULL;                                              \
+                                                                        \
+    return ret;                                                         \
+  }                                                                     \
+                                                                        \
+  struct_name new_destructable_##struct_name(size_t init_cap,           \
+                                             void (*destructor)(key_type, \
+                                                                value_type)) { \
+    struct_name ret = new_##struct_name(init_cap);                      \
+    ret.destructor = destructor;                                        \
+    return ret;                                                         \
+  }                                                                     \
+                                                                        \
+  void apply_##struct_name(struct_name* tbl,                            \
+                           void (*func)(key_type, value_type)) {        \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+                                                                        \
+    for (size_t i = 0; i < tbl->cap; ++i) {                             \
+      if (tbl->entries[i].used)                                         \
+        func(tbl->entries[i].key, tbl->entries[i].value);               \
+    }                                                                   \
+  }                                                                     \
+                                                                        \
+  void destroy_##struct_name(struct_name* tbl) {                        \
+    assert(tbl != NULL);                                                \
+                                                                        \
+    if (tbl->entries == NULL)                                           \
+      return;                                                           \
+                                                                        \
+    if (tbl->destructor != NULL)                                        \
+      apply_##struct_name(tbl, tbl->destructor);                        \
+                                                                        \
+    free(tbl->entries);                                                 \
+                                                                        \
+    tbl->entries = NULL;                                                \
+    tbl->cap = tbl->len = 0;                                            \
+  }                                                                     \
+                                                                        \
+  void empty_##struct_name(struct_name* tbl) {                          \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+                                                                        \
+    if (tbl->destructor != NULL)                                        \
+      apply_##struct_name(tbl, tbl->destructor);                        \
+                                                                        \
+    memset(tbl->entries, 0, tbl->cap * sizeof(struct_name##Entry));     \
+    tbl->len = 0;                                                       \
+  }                                                                     \
+                                                                        \
+  size_t length_##struct_name(struct_name* tbl) {                       \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+    return tbl->len;                                                    \
+  }                                                                     \
+                                                                        \
+  /* Find the slot holding key or the empty slot where it would go */   \
+  static size_t __find_slot_##struct_name(struct_name* tbl, key_type key) { \
+    size_t mask = tbl->cap - 1;                                         \
+    size_t i = hash_fn(key) & mask;                                     \
+                                                                        \
+    while (tbl->entries[i].used && !equal_fn(tbl->entries[i].key, key)) \
+      i = (i + 1) & mask;                                               \
+                                                                        \
+    return i;                                                           \
+  }                                                                     \
+                                                                        \
+  static void __grow_##struct_name(struct_name* tbl) {                  \
+    struct_name##Entry* old_entries = tbl->entries;                     \
+    size_t old_cap = tbl->cap;                                          \
+                                                                        \
+    tbl->cap = 2 * tbl->cap;                                            \
+    tbl->entries = (struct_name##Entry*) calloc(tbl->cap,               \
+                                                sizeof(struct_name##Entry)); \
+                                                                        \
+    if (tbl->entries == NULL) {                                         \
+      fprintf(stderr, "ERROR: Failed to reallocate struct_name"         \
+              " contents\n");                                           \
+      abort();                                                          \
+    }                                                                   \
+                                                                        \
+    for (size_t i = 0; i < old_cap; ++i) {                              \
+      if (old_entries[i].used)                                          \
+        tbl->entries[__find_slot_##struct_name(tbl, old_entries[i].key)] = \
+          old_entries[i];                                               \
+    }                                                                   \
+                                                                        \
+    free(old_entries);                                                  \
+  }                                                                     \
+                                                                        \
+  value_type* lookup_##struct_name(struct_name* tbl, key_type key) {    \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+                                                                        \
+    struct_name##Entry* e = &tbl->entries[__find_slot_##struct_name(tbl, key)]; \
+                                                                        \
+    return e->used ? &e->value : NULL;                                  \
+  }                                                                     \
+                                                                        \
+  void insert_##struct_name(struct_name* tbl, key_type key,             \
+                            value_type value) {                         \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+                                                                        \
+    /* Keep the load factor at or below three quarters */              \
+    if ((tbl->len + 1) * 4 > tbl->cap * 3)                              \
+      __grow_##struct_name(tbl);                                        \
+                                                                        \
+    struct_name##Entry* e = &tbl->entries[__find_slot_##struct_name(tbl, key)]; \
+                                                                        \
+    if (e->used) {                                                      \
+      if (tbl->destructor != NULL)                                      \
+        tbl->destructor(e->key, e->value);                              \
+    }                                                                   \
+    else {                                                              \
+      ++tbl->len;                                                       \
+    }                                                                   \
+                                                                        \
+    e->key = key;                                                       \
+    e->value = value;                                                   \
+    e->used = true;                                                     \
+  }                                                                     \
+                                                                        \
+  bool remove_##struct_name(struct_name* tbl, key_type key) {           \
+    assert(tbl != NULL);                                                \
+    assert(tbl->entries != NULL); /* Make sure the structure is valid */ \
+                                                                        \
+    size_t mask = tbl->cap - 1;                                         \
+    size_t i = __find_slot_##struct_name(tbl, key);                     \
+                                                                        \
+    if (!tbl->entries[i].used)                                          \
+      return false;                                                     \
+                                                                        \
+    if (tbl->destructor != NULL)                                        \
+      tbl->destructor(tbl->entries[i].key, tbl->entries[i].value);      \
+                                                                        \
+    /* Shift back every following entry that may no longer be reachable */ \
+    for (size_t j = (i + 1) & mask; tbl->entries[j].used; j = (j + 1) & mask) { \
+      size_t home = hash_fn(tbl->entries[j].key) & mask;                \
+      bool stays = (j > i) ? (home > i && home <= j)                    \
+                           : (home > i || home <= j);                   \
+                                                                        \
+      if (!stays) {                                                     \
+        tbl->entries[i] = tbl->entries[j];                              \
+        i = j;                                                          \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    tbl->entries[i].used = false;                                       \
+    --tbl->len;                                                         \
+                                                                        \
+    return true;                                                        \
+  }
+
+#endif //SRC_HASH_TABLE_H
@@ -23,13 +23,33 @@
 typedef struct MemoryPool {
   void* pool;  /**< Pointer to the top of the memory pool */
   size_t size; /**< Size of the memory pool in bytes */
-  void* next;  /**< The next pointer to be returned from an allocation */
 } MemoryPool;
 
 IMPLEMENT_DEQUE_STRUCT(MemoryPoolDeque, MemoryPool);
 IMPLEMENT_DEQUE(MemoryPoolDeque, MemoryPool);
 
-static MemoryPoolDeque pool_deq = { NULL, 0, 0, 0, NULL };
+/**
+ * @brief A set of MemoryPools that are reset and destroyed together
+ */
+struct MemoryPoolArena {
+  MemoryPoolDeque pool_deq; /**< Blocks of the arena, the newest is at the
+                             * back */
+  size_t init_size;         /**< Size requested when the arena was created */
+  size_t current_size;      /**< Size of the MemoryPool at the back of
+                             * pool_deq that allocations come from */
+  MemoryPoolCursor cursor;  /**< Free space of the back MemoryPool while the
+                             * arena is not in use */
+};
+
+// Arena behind initialize_memory_pool(), reset_memory_pool() and
+// destroy_memory_pool()
+static MemoryPoolArena default_arena = { { NULL, 0, 0, 0, NULL }, 0, 0, { NULL, NULL } };
+
+// Arena allocations of this thread come from
+static _Thread_local MemoryPoolArena* current_arena = NULL;
+
+// Free space of the MemoryPool allocations of this thread come from
+_Thread_local MemoryPoolCursor __memory_pool_cursor = { NULL, NULL };
 
 // Creates a single memory pool an returns a copy If the `size` parameter is
 // zero then this function will not allocate any space for later MemoryPool
@@ -47,8 +67,7 @@ static MemoryPool __initialize_memory_pool(size_t size) {
 
   return (MemoryPool) {
     mem,
-    size,
-    mem
+    size
   };
 }
 
@@ -80,11 +99,28 @@ static void __destroy_memory_pool(MemoryPool mp) {
   mp.pool = NULL;
 }
 
-void initialize_memory_pool(size_t size) {
+// The cursor of an arena. The cursor of the arena in use lives in
+// __memory_pool_cursor.
+static MemoryPoolCursor* __arena_cursor(MemoryPoolArena* arena) {
+  return (arena == current_arena) ? &__memory_pool_cursor : &arena->cursor;
+}
+
+// Start allocating from a MemoryPool
+static void __use_memory_pool(MemoryPoolArena* arena, MemoryPool pool) {
+  MemoryPoolCursor* cursor = __arena_cursor(arena);
+
+  arena->current_size = pool.size;
+  cursor->next = pool.pool;
+  cursor->end = (char*) pool.pool + pool.size;
+}
+
+// Set up an arena with a single MemoryPool
+static void __initialize_arena(MemoryPoolArena* arena, size_t size) {
   if (size == 0)
     size = 1;
 
-  pool_deq = new_destructable_MemoryPoolDeque(10, __destroy_memory_pool);
+  arena->init_size = size;
+  arena->pool_deq = new_destructable_MemoryPoolDeque(10, __destroy_memory_pool);
 
   MemoryPool pool = __initialize_memory_pool(size);
 
@@ -92,56 +128,144 @@ void initialize_memory_pool(size_t size) {
     // We are running low on memory. Try smaller allocations or exit Quash
     pool = __low_memory_initialize_memory_pool(1, size);
 
-  push_back_MemoryPoolDeque(&pool_deq, pool);
+  push_back_MemoryPoolDeque(&arena->pool_deq, pool);
+  __use_memory_pool(arena, pool);
 }
 
-void* memory_pool_alloc(size_t size) {
-  assert(!is_empty_MemoryPoolDeque(&pool_deq));
+void initialize_memory_pool(size_t size) {
+  __initialize_arena(&default_arena, size);
 
-  MemoryPool pool = peek_back_MemoryPoolDeque(&pool_deq);
-  size_t init_size = peek_front_MemoryPoolDeque(&pool_deq).size;
+  if (current_arena == NULL)
+    use_memory_pool_arena(&default_arena);
+}
 
-  assert(pool.pool != NULL);
-  assert(pool.size != 0);
-  assert(pool.next != NULL);
+MemoryPoolArena* new_memory_pool_arena(size_t size) {
+  MemoryPoolArena* arena = malloc(sizeof(MemoryPoolArena));
 
-  while (pool.next - pool.pool + size > pool.size) {
-    // There is not enough room in the current memory pool to fit the
-    // allocation. Create a new memory pool large enough to hold it. 
-    size_t length_pool_deq = length_MemoryPoolDeque(&pool_deq);
-    size_t new_pool_size = init_size * (2 << (length_pool_deq - 1));
+  if (arena == NULL) {
+    fprintf(stderr, "ERROR: Unable to allocate a memory pool arena.\n");
+    exit(-1);
+  }
 
-    if (new_pool_size < size) {
-      // The next pool size selected wasn't enough space. We have to have to add
-      // something onto the deque since the new pool size is dependent on the
-      // size of the deque.
-      pool = __initialize_memory_pool(0);
-    }
-    else {
-      // Create a MemoryPool with the correct amount of space
-      pool = __initialize_memory_pool(new_pool_size);
+  arena->cursor = (MemoryPoolCursor) { NULL, NULL };
+  __initialize_arena(arena, size);
 
-      if (pool.pool == NULL)
-        // We are running low on memory. Try smaller allocations or exit Quash
-        pool = __low_memory_initialize_memory_pool(size, new_pool_size);
-    }
+  return arena;
+}
 
-    push_back_MemoryPoolDeque(&pool_deq, pool);
-  }
+MemoryPoolArena* use_memory_pool_arena(MemoryPoolArena* arena) {
+  MemoryPoolArena* prev = current_arena;
+
+  if (prev == arena)
+    return prev;
+
+  // Park the cursor of the arena that was in use
+  if (prev != NULL)
+    prev->cursor = __memory_pool_cursor;
+
+  current_arena = arena;
+  __memory_pool_cursor = (arena != NULL) ? arena->cursor
+                                         : (MemoryPoolCursor) { NULL, NULL };
+
+  return prev;
+}
+
+// Called by memory_pool_alloc_aligned() when the current MemoryPool is out of
+// space
+void* __memory_pool_alloc_slow(size_t size, size_t align) {
+  MemoryPoolArena* arena = current_arena;
+
+  assert(arena != NULL);
+  assert(!is_empty_MemoryPoolDeque(&arena->pool_deq));
+
+  // There is not enough room in the current memory pool to fit the
+  // allocation. Create a new memory pool at least twice as large that can
+  // hold it even in the worst case of alignment. Memory from malloc() is
+  // already aligned for max_align_t.
+  size_t required_size = size + (align > _Alignof(max_align_t) ? align : 0);
+  size_t new_pool_size = 2 * arena->current_size;
+
+  if (new_pool_size < required_size)
+    new_pool_size = required_size;
+
+  MemoryPool pool = __initialize_memory_pool(new_pool_size);
+
+  if (pool.pool == NULL)
+    // We are running low on memory. Try smaller allocations or exit Quash
+    pool = __low_memory_initialize_memory_pool(required_size, new_pool_size);
 
-  assert(pool.next == peek_back_MemoryPoolDeque(&pool_deq).next);
-  void* ret = pool.next;
-  pool.next += size;
+  push_back_MemoryPoolDeque(&arena->pool_deq, pool);
+  __use_memory_pool(arena, pool);
 
-  // Update record
-  update_back_MemoryPoolDeque(&pool_deq, pool);
+  void* ret = memory_pool_alloc_aligned(size, align);
+
+  assert(ret != NULL);
 
   return ret;
 }
 
-// Free all memory contained in the MemoryPoolDeque
+// Grow an allocation in place when it is the newest one or move it otherwise
+void* memory_pool_realloc(void* ptr, size_t old_size, size_t new_size,
+                          size_t align) {
+  if (memory_pool_try_extend(ptr, old_size, new_size))
+    return ptr;
+
+  void* ret = memory_pool_alloc_aligned(new_size, align);
+
+  memcpy(ret, ptr, old_size);
+
+  return ret;
+}
+
+// Make all the memory in an arena available again without giving it back
+void reset_memory_pool_arena(MemoryPoolArena* arena) {
+  assert(!is_empty_MemoryPoolDeque(&arena->pool_deq));
+
+  // Pools only grow so the newest is the largest. The older ones would never
+  // be reached again once allocations start from the largest.
+  while (length_MemoryPoolDeque(&arena->pool_deq) > 1)
+    __destroy_memory_pool(pop_front_MemoryPoolDeque(&arena->pool_deq));
+
+  MemoryPool pool = peek_back_MemoryPoolDeque(&arena->pool_deq);
+
+  if (pool.size > MEMORY_POOL_MAX_RETAINED && pool.size > arena->init_size) {
+    // Do not hold on to the memory of a single unusually large command
+    __destroy_memory_pool(pool);
+    pool = __initialize_memory_pool(arena->init_size);
+
+    if (pool.pool == NULL)
+      pool = __low_memory_initialize_memory_pool(1, arena->init_size);
+
+    update_back_MemoryPoolDeque(&arena->pool_deq, pool);
+  }
+
+  __use_memory_pool(arena, pool);
+}
+
+void reset_memory_pool() {
+  reset_memory_pool_arena(&default_arena);
+}
+
+// Free all memory contained in an arena
+static void __destroy_arena(MemoryPoolArena* arena) {
+  if (arena == current_arena)
+    use_memory_pool_arena(NULL);
+
+  destroy_MemoryPoolDeque(&arena->pool_deq);
+  arena->cursor = (MemoryPoolCursor) { NULL, NULL };
+  arena->current_size = 0;
+}
+
+void destroy_memory_pool_arena(MemoryPoolArena* arena) {
+  if (arena == NULL)
+    return;
+
+  __destroy_arena(arena);
+  free(arena);
+}
+
 void destroy_memory_pool() {
-  destroy_MemoryPoolDeque(&pool_deq);
+  __destroy_arena(&default_arena);
 }
 
 // Simple replacement for strdup() that uses the memory pool rather than malloc
@@ -149,7 +273,7 @@ char* memory_pool_strdup(const char* str) {
   assert(str != NULL);
 
   size_t len = strlen(str) + 1;
-  char* ret = memory_pool_alloc(len);
+  char* ret = memory_pool_alloc_aligned(len, 1);
 
   strcpy(ret, str);
 
@@ -14,24 +14,114 @@
  * comfortable with malloc based memory management. YOU WILL BE PENALIZED FOR
  * USING ANYTHING IN THIS FILE TO HIDE MEMORY LEAKS.
  *
- * @warning The memory pool allocations are not thread safe
+ * @warning The memory pool allocations are not thread safe. Each thread
+ * allocates from the arena it selected with use_memory_pool_arena() and an
+ * arena must only be used by one thread at a time.
  */
 
 #ifndef SRC_PARSING_MEMORY_POOL_H
 #define SRC_PARSING_MEMORY_POOL_H
 
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #include "deque.h"
 
+/**
+ * @brief The free space of the block the memory pool is currently allocating
+ * from
+ *
+ * @note Only the allocation functions in this file should touch this.
+ */
+typedef struct MemoryPoolCursor {
+  char* next; /**< First free byte of the block */
+  char* end;  /**< One past the last byte of the block */
+} MemoryPoolCursor;
+
+/**
+ * @brief A memory pool that can be reset and destroyed on its own
+ *
+ * The functions without "arena" in their name work on a default arena. Other
+ * arenas are created with @a new_memory_pool_arena().
+ */
+typedef struct MemoryPoolArena MemoryPoolArena;
+
+/** @cond Doxygen_Suppress */
+extern _Thread_local MemoryPoolCursor __memory_pool_cursor;
+
+void* __memory_pool_alloc_slow(size_t size, size_t align);
+/** @endcond Doxygen_Suppress */
+
 /**
  * @brief Allocate the memory pool
  *
+ * The calling thread allocates from it unless it already selected an arena.
+ *
  * @param size The initial size of the memory pool. If this value is zero then a
  * default size of one is used.
  */
 void initialize_memory_pool(size_t size);
 
+/**
+ * @brief Create an arena separate from the default memory pool
+ *
+ * @param size The initial size of the arena. If this value is zero then a
+ * default size of one is used.
+ *
+ * @return The new arena. It is not used until it is passed to @a
+ * use_memory_pool_arena().
+ */
+MemoryPoolArena* new_memory_pool_arena(size_t size);
+
+/**
+ * @brief Make the calling thread allocate from an arena
+ *
+ * @param arena The arena to allocate from or NULL for none
+ *
+ * @return The arena the thread allocated from before so it can be restored
+ */
+MemoryPoolArena* use_memory_pool_arena(MemoryPoolArena* arena);
+
+/**
+ * @brief Free an arena and every allocation made from it
+ *
+ * @param arena An arena from @a new_memory_pool_arena()
+ */
+void destroy_memory_pool_arena(MemoryPoolArena* arena);
+
+/**
+ * @brief Reserve some space in the memory pool aligned to a boundary
+ *
+ * The common case only moves a pointer forward. A new block is only requested
+ * when the current one is out of space.
+ *
+ * @param size Size in bytes of the requested reserved space
+ *
+ * @param align Alignment of the returned pointer. Must be a power of two.
+ *
+ * @return A pointer to a unique array of size bytes that is a multiple of
+ * align
+ *
+ * @sa memory_pool_alloc()
+ */
+static inline void* memory_pool_alloc_aligned(size_t size, size_t align) {
+  assert(align != 0 && (align & (align - 1)) == 0);
+
+  MemoryPoolCursor* cur = &__memory_pool_cursor;
+  uintptr_t ret = ((uintptr_t) cur->next + align - 1) & ~(uintptr_t) (align - 1);
+
+  if (cur->next == NULL || ret > (uintptr_t) cur->end ||
+      size > (uintptr_t) cur->end - ret)
+    return __memory_pool_alloc_slow(size, align);
+
+  cur->next = (char*) ret + size;
+
+  return (void*) ret;
+}
+
 /**
  * @brief Reserve some space in the memory pool and returns a unique address
  * that can be written to and read from. This can be thought of exactly like
@@ -42,7 +132,93 @@ void initialize_memory_pool(size_t size);
  *
  * @return A pointer to a unique array of size bytes
  */
-void* memory_pool_alloc(size_t size);
+static inline void* memory_pool_alloc(size_t size) {
+  return memory_pool_alloc_aligned(size, _Alignof(max_align_t));
+}
+
+/**
+ * @brief Grow an allocation without moving it
+ *
+ * This only works for the most recent allocation of the arena in use and only
+ * while the block it is in has room.
+ *
+ * @param ptr An allocation from the memory pool
+ *
+ * @param old_size Size in bytes of @a ptr
+ *
+ * @param new_size Size in bytes to grow @a ptr to
+ *
+ * @return True if @a ptr now holds @a new_size bytes
+ */
+static inline bool memory_pool_try_extend(void* ptr, size_t old_size,
+                                          size_t new_size) {
+  assert(new_size >= old_size);
+
+  MemoryPoolCursor* cur = &__memory_pool_cursor;
+
+  if (cur->next == NULL || (char*) ptr + old_size != cur->next ||
+      new_size - old_size > (size_t) (cur->end - cur->next))
+    return false;
+
+  cur->next = (char*) ptr + new_size;
+
+  return true;
+}
+
+/**
+ * @brief Grow an allocation of the memory pool keeping its contents
+ *
+ * The allocation is extended in place with @a memory_pool_try_extend() when
+ * possible. Otherwise it is copied to a new allocation and the old one is left
+ * in the pool.
+ *
+ * @param ptr An allocation from the memory pool
+ *
+ * @param old_size Size in bytes of @a ptr
+ *
+ * @param new_size Size in bytes to grow @a ptr to
+ *
+ * @param align Alignment of @a ptr
+ *
+ * @return The grown allocation
+ */
+void* memory_pool_realloc(void* ptr, size_t old_size, size_t new_size,
+                          size_t align);
+
+/** @cond Doxygen_Suppress */
+// Allocations of the memory pool are only freed along with their arena
+static inline void __memory_pool_release(void* ptr) {
+  (void) ptr;
+}
+/** @endcond Doxygen_Suppress */
+
+/**
+ * @def MEMORY_POOL_MAX_RETAINED
+ *
+ * @brief Largest number of bytes @a reset_memory_pool() keeps for later
+ * allocations
+ */
+#define MEMORY_POOL_MAX_RETAINED (1 << 20)
+
+/**
+ * @brief Invalidate every allocation in the memory pool but keep its memory
+ * for the allocations that follow
+ *
+ * Only the largest block of the pool is kept, so after a few commands the
+ * pool settles on a block that fits a whole command and allocations stop
+ * reaching malloc(). A block larger than @a MEMORY_POOL_MAX_RETAINED is given
+ * back and replaced by one of the initial size.
+ *
+ * @sa initialize_memory_pool(), destroy_memory_pool()
+ */
+void reset_memory_pool();
+
+/**
+ * @brief @a reset_memory_pool() for an arena other than the default one
+ *
+ * @param arena The arena to reset
+ */
+void reset_memory_pool_arena(MemoryPoolArena* arena);
 
 /**
  * @brief Free all memory allocated in the memory pool
@@ -63,256 +239,41 @@ char* memory_pool_strdup(const char* str);
  * @brief Generates a @a memory_pool_alloc() based set of functions for use with
  * a structure generated by @a IMPLEMENT_DEQUE_STRUCT
  *
+ * A deque that grows while its storage is still the most recent allocation of
+ * the arena grows in place rather than leaving its old storage behind.
+ *
  * @param struct_name The name of the structure
  *
  * @param type The name of the type of elements stored in the @a struct_name
  * structure
  *
- * @sa IMPLEMENT_DEQUE_STRUCT, PROTOTYPE_DEQUE, IMPLEMENT_DEQUE_MEMORY_POOL,
- * memory_pool_alloc()
+ * @sa IMPLEMENT_DEQUE_STRUCT, PROTOTYPE_DEQUE, IMPLEMENT_DEQUE_ALLOCATOR,
+ * memory_pool_alloc(), memory_pool_realloc()
  */
 #define IMPLEMENT_DEQUE_MEMORY_POOL(struct_name, type)                  \
-                                                                        \
-  void apply_##struct_name(struct_name*, void (*)(type));               \
-                                                                        \
-  struct_name new_##struct_name(size_t init_cap) {                      \
-    struct_name ret;                                                    \
-                                                                        \
-    if (init_cap > 0)                                                   \
-      ret.cap = init_cap;                                               \
-    else                                                                \
-      ret.cap = 1;                                                      \
-                                                                        \
-    ret.data = (type*) memory_pool_alloc(ret.cap * sizeof(type));       \
-                                                                        \
-    if (ret.data == NULL) {                                             \
-      fprintf(stderr, "ERROR: Failed to reallocate struct_name"         \
-              " contents");                                             \
-      abort();                                                          \
-    }                                                                   \
-                                                                        \
-    ret.front = ret.back = 0;                                           \
-    ret.destructor = NULL;                                              \
-                                                                        \
-    return ret;                                                         \
-  }                                                                     \
-                                                                        \
-  struct_name new_destructable_##struct_name(size_t init_cap,           \
-                                             void (*destructor)(type)){ \
-    struct_name ret = new_##struct_name(init_cap);                      \
-    ret.destructor = destructor;                                        \
-    return ret;                                                         \
-  }                                                                     \
-                                                                        \
-  void destroy_##struct_name(struct_name* deq) {                        \
-    assert(deq != NULL);                                                \
-                                                                        \
-    if (deq->data == NULL)                                              \
-      return;                                                           \
-                                                                        \
-    if (deq->destructor != NULL)                                        \
-      apply_##struct_name(deq, deq->destructor);                        \
-                                                                        \
-    deq->data = NULL;                                                   \
-    deq->cap = 0;                                                       \
-    deq->front = deq->back = 0;                                         \
-  }                                                                     \
-                                                                        \
-  void empty_##struct_name(struct_name* deq) {                          \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-                                                                        \
-    if (deq->destructor != NULL)                                        \
-      apply_##struct_name(deq, deq->destructor);                        \
-                                                                        \
-    deq->front = deq->back = 0;                                         \
-  }                                                                     \
-                                                                        \
-  bool is_empty_##struct_name(struct_name* deq) {                       \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    return deq->front == deq->back;                                     \
-  }                                                                     \
-                                                                        \
-  size_t length_##struct_name(struct_name* deq) {                       \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    return (deq->back - deq->front + deq->cap) % deq->cap;              \
-  }                                                                     \
-                                                                        \
-  static void __reallign_##struct_name(struct_name* deq) {              \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-                                                                        \
-    if (deq->front != 0) {                                              \
-      type* old_data = deq->data;                                       \
-      size_t len = length_##struct_name(deq);                           \
-                                                                        \
-      deq->data = (type*) memory_pool_alloc(deq->cap * sizeof(type));   \
-                                                                        \
-      if (deq->data == NULL) {                                          \
-        fprintf(stderr, "ERROR: Failed to reallocate struct_name"       \
-                " contents");                                           \
-        abort();                                                        \
-      }                                                                 \
-                                                                        \
-      size_t i;                                                         \
-                                                                        \
-      for (i = 0; i < len; ++i)                                         \
-        deq->data[i] = old_data[(deq->front + i) % deq->cap];           \
-                                                                        \
-      deq->front = 0;                                                   \
-      deq->back = i;                                                    \
-    }                                                                   \
-  }                                                                     \
-                                                                        \
-  type* as_array_##struct_name(struct_name* deq, size_t* len) {         \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-                                                                        \
-    __reallign_##struct_name(deq);                                      \
-                                                                        \
-    type* ret = deq->data;                                              \
-                                                                        \
-    if (len != NULL)                                                    \
-      *len = length_##struct_name(deq);                                 \
-                                                                        \
-    deq->data = NULL;                                                   \
-    deq->cap = deq->front = deq->back = 0;                              \
-                                                                        \
-    return ret;                                                         \
-  }                                                                     \
-                                                                        \
-  void apply_##struct_name(struct_name* deq, void (*func)(type)) {      \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-                                                                        \
-    size_t len = length_##struct_name(deq);                             \
-                                                                        \
-    for (size_t i = 0; i < len; ++i) {                                  \
-      func(deq->data[(deq->front + i) % deq->cap]);                     \
-    }                                                                   \
-  }                                                                     \
-                                                                        \
-  static void __on_push_##struct_name(struct_name* deq) {               \
-    if (deq->front == (deq->back + 1) % deq->cap) {                     \
-      type* old_data = deq->data;                                       \
-      size_t old_cap = deq->cap;                                        \
-                                                                        \
-      deq->cap = 2 * deq->cap;                                          \
-      deq->data = (type*) memory_pool_alloc(deq->cap * sizeof(type));   \
-                                                                        \
-      if (deq->data == NULL) {                                          \
-        fprintf(stderr, "ERROR: Failed to reallocate struct_name"       \
-                " contents\n");                                         \
-        abort();                                                        \
-      }                                                                 \
-                                                                        \
-      size_t i;                                                         \
-                                                                        \
-      for (i = 0; i < old_cap - 1; ++i)                                 \
-        deq->data[i] = old_data[(deq->front + i) % old_cap];            \
-                                                                        \
-      deq->front = 0;                                                   \
-      deq->back = i;                                                    \
-    }                                                                   \
-  }                                                                     \
-                                                                        \
-  static void __on_pop_##struct_name(struct_name* deq) {                \
-    if (is_empty_##struct_name(deq)) {                                  \
-      fprintf(stderr, "ERROR: Cannot pop from of struct_name while it " \
-              "is empty\n");                                            \
-      abort();                                                          \
-    }                                                                   \
-  }                                                                     \
-                                                                        \
-  void push_front_##struct_name(struct_name* deq, type element) {       \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    __on_push_##struct_name(deq);                                       \
-    deq->front = (deq->front + deq->cap - 1) % deq->cap;                \
-    deq->data[deq->front] = element;                                    \
-  }                                                                     \
-                                                                        \
-  void push_back_##struct_name(struct_name* deq, type element) {        \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    __on_push_##struct_name(deq);                                       \
-    deq->data[deq->back] = element;                                     \
-    deq->back = (deq->back + 1) % deq->cap;                             \
-  }                                                                     \
-                                                                        \
-  type pop_front_##struct_name(struct_name* deq) {                      \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    __on_pop_##struct_name(deq);                                        \
-    size_t old_front = deq->front;                                      \
-    deq->front = (deq->front + 1) % deq->cap;                           \
-    return deq->data[old_front];                                        \
-  }                                                                     \
-                                                                        \
-  type pop_back_##struct_name(struct_name* deq) {                       \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    __on_pop_##struct_name(deq);                                        \
-    deq->back = (deq->back + deq->cap - 1) % deq->cap;                  \
-    return deq->data[deq->back];                                        \
-  }                                                                     \
-                                                                        \
-  type peek_front_##struct_name(struct_name* deq) {                     \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-    return deq->data[deq->front];                                       \
-  }                                                                     \
-                                                                        \
-  type peek_back_##struct_name(struct_name* deq) {                      \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-    return deq->data[(deq->back + deq->cap - 1) % deq->cap];            \
-  }                                                                     \
-                                                                        \
-  void update_front_##struct_name(struct_name* deq, type element) {     \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-    deq->data[deq->front] = element;                                    \
-  }                                                                     \
-                                                                        \
-  void update_back_##struct_name(struct_name* deq, type element) {      \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-    deq->data[(deq->back + deq->cap - 1) % deq->cap] = element;         \
-  }                                                                     \
-                                                                        \
-  void update_and_destroy_front_##struct_name(struct_name* deq,         \
-                                              type element) {           \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-                                                                        \
-    size_t idx = deq->front;                                            \
-                                                                        \
-    if (deq->destructor != NULL)                                        \
-      deq->destructor(deq->data[idx]);                                  \
-                                                                        \
-    deq->data[idx] = element;                                           \
-  }                                                                     \
-                                                                        \
-  void update_and_destroy_back_##struct_name(struct_name* deq,          \
-                                             type element) {            \
-    assert(deq != NULL);                                                \
-    assert(deq->data != NULL); /* Make sure the structure is valid */   \
-    assert(!is_empty_##struct_name(deq));                               \
-                                                                        \
-    size_t idx = (deq->back + deq->cap - 1) % deq->cap;                 \
-                                                                        \
-    if (deq->destructor != NULL)                                        \
-      deq->destructor(deq->data[idx]);                                  \
-                                                                        \
-    deq->data[idx] = element;                                           \
-  }
+  IMPLEMENT_DEQUE_ALLOCATOR(struct_name, type,                          \
+                            memory_pool_alloc_aligned,                  \
+                            memory_pool_realloc, __memory_pool_release)
+
+/**
+ * @brief Generates a @a memory_pool_alloc() based set of functions for use with
+ * a structure generated by @a IMPLEMENT_SMALL_DEQUE_STRUCT
+ *
+ * Nothing is taken from the pool until the deque outgrows its inline storage.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The inline capacity given to @a IMPLEMENT_SMALL_DEQUE_STRUCT()
+ *
+ * @sa IMPLEMENT_SMALL_DEQUE_STRUCT, IMPLEMENT_DEQUE_MEMORY_POOL
+ */
+#define IMPLEMENT_SMALL_DEQUE_MEMORY_POOL(struct_name, type, n)         \
+  IMPLEMENT_SMALL_DEQUE_ALLOCATOR(struct_name, type, n,                 \
+                                  memory_pool_alloc_aligned,            \
+                                  memory_pool_realloc,                  \
+                                  __memory_pool_release)
 
 #endif
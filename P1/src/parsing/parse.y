@@ -7,16 +7,6 @@
 #include "parsing_interface.h"
 #include "parse.tab.h"
 #include "memory_pool.h"
-
-extern int yylineno;
-extern char* yytext;
-extern FILE* yyin;
-
-extern void yyerror(CommandHolder**, char*);
-extern int yyparse(CommandHolder**);
-extern int yylex();
-
-int yyerrstatus = 0;
 %}
 
 %code requires {
@@ -26,6 +16,11 @@ int yyerrstatus = 0;
 #include "parsing_interface.h"
 #include "parse.tab.h"
 #include "memory_pool.h"
+
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
 }
 
 %union {
@@ -34,11 +29,23 @@ int yyerrstatus = 0;
   Command cmd;
   CommandHolder holder;
   CommandHolder* holder_arr;
-  CmdStrs cmd_strs;
-  Cmds cmd_list;
+  ArgvBuilder argv;
+  PipelineBuilder pipeline;
   Redirect redirect;
 }
 
+%code {
+extern int yylex(YYSTYPE* yylval_param, yyscan_t yyscanner);
+extern int yyget_lineno(yyscan_t yyscanner);
+
+static void yyerror(yyscan_t scanner, quash_parser_t* parser,
+                    CommandHolder** __ret_cmds, const char* str);
+}
+
+%define api.pure full
+
+%lex-param { yyscan_t scanner }
+%parse-param { yyscan_t scanner } { quash_parser_t* parser }
 %parse-param { CommandHolder** __ret_cmds }
 
 /* Terminals */
@@ -52,8 +59,8 @@ int yyerrstatus = 0;
 %type <redirect> redir redir_inner
 %type <holder> cmd_top
 %type <cmd> cmd_content
-%type <cmd_strs> cmd cmd_arguments
-%type <cmd_list> cmds
+%type <argv> cmd cmd_arguments
+%type <pipeline> cmds
 %type <cmd_arr> top
 
 /* Start symbol */
@@ -66,19 +73,22 @@ top:    EOC_TOK {
 
   YYACCEPT;
 }
-|       cmds EOC_TOK {
-  push_back_Cmds(&$1, mk_command_holder(NULL, NULL, 0, mk_eoc()));
+|       END {
+  *__ret_cmds = NULL;
 
-  *__ret_cmds = as_array_Cmds(&$1, NULL);
+  reached_end_of_input(parser);
 
   YYACCEPT;
 }
-|       cmds END {
-  push_back_Cmds(&$1, mk_command_holder(NULL, NULL, 0, mk_eoc()));
+|       cmds EOC_TOK {
+  *__ret_cmds = as_array_pipeline($1);
 
-  *__ret_cmds = as_array_Cmds(&$1, NULL);
+  YYACCEPT;
+}
+|       cmds END {
+  *__ret_cmds = as_array_pipeline($1);
 
-  end_main_loop(EXIT_SUCCESS);
+  reached_end_of_input(parser);
 
   YYACCEPT;
 }
@@ -90,7 +100,7 @@ top:    EOC_TOK {
 |       error END {
   *__ret_cmds = NULL;
 
-  end_main_loop(EXIT_FAILURE);
+  reached_end_of_input(parser);
 
   YYABORT;
 }
@@ -98,25 +108,12 @@ top:    EOC_TOK {
 
 
 cmds:   cmd_top {
-  Cmds cs = new_Cmds(1);
-
-  push_front_Cmds(&cs, $1);
-
-  $$ = cs;
+  $$ = mk_pipeline($1);
 }
-|       cmd_top PIPE cmds {
-  CommandHolder prev = pop_front_Cmds(&$3);
-
-  $1.flags = ($1.flags & ~(REDIRECT_APPEND | REDIRECT_OUT)) | PIPE_OUT;
-  prev.flags = (prev.flags & ~REDIRECT_IN) | PIPE_IN;
-
-  if (prev.flags & BACKGROUND)
-    $1.flags |= BACKGROUND;
-
-  push_front_Cmds(&$3, prev);
-  push_front_Cmds(&$3, $1);
+|       cmds PIPE cmd_top {
+  push_back_pipeline(&$1, $3);
 
-  $$ = $3;
+  $$ = $1;
 }
 
 
@@ -133,7 +130,17 @@ cmd_top: cmd_content redir cmd_bg {
 
 
 cmd_content: cmd {
-  $$ = mk_generic_command(as_array_CmdStrs(&$1, NULL));
+  char** args = as_array_argv($1);
+
+  // hash is not a keyword so it can still be used as an ordinary argument
+  if (strcmp(args[0], "hash") == 0)
+    $$ = mk_hash_command(args + 1);
+  else if (strcmp(args[0], "parsecache") == 0)
+    $$ = mk_parse_cache_command(args + 1);
+  else if (strcmp(args[0], "source") == 0)
+    $$ = mk_source_command(args + 1);
+  else
+    $$ = mk_generic_command(args);
 }
 |       ECHO_TOK {
   char** cmd = memory_pool_alloc(sizeof(char*));
@@ -141,24 +148,16 @@ cmd_content: cmd {
   $$ = mk_echo_command(cmd);
 }
 |       ECHO_TOK cmd_arguments {
-  $$ = mk_echo_command(as_array_CmdStrs(&$2, NULL));
+  $$ = mk_echo_command(as_array_argv($2));
 }
 |       EXPORT_TOK ID EQUALS string {
   $$ = mk_export_command($2, $4);
 }
 |       CD_TOK {
-  $$ = mk_cd_command(memory_pool_strdup(lookup_env("HOME")));
+  $$ = mk_cd_command(NULL);
 }
 |       CD_TOK string {
-  char* resolved_path;
-  char* ret = NULL;
-
-  if ((resolved_path = realpath($2, NULL)) != NULL) {
-    ret = memory_pool_strdup(resolved_path);
-    free(resolved_path);
-  }
-
-  $$ = mk_cd_command(ret);
+  $$ = mk_cd_command($2);
 }
 |       PWD_TOK {
   $$ = mk_pwd_command();
@@ -235,34 +234,24 @@ cmd_bg: {
 
 
 
-cmd:    first_string cmd_arguments {
-  push_front_CmdStrs(&$2, $1);
-
-  $$ = $2;
+cmd:    first_string {
+  $$ = mk_argv($1);
 }
-|       first_string {
-  CmdStrs args = new_CmdStrs(1);
-
-  push_front_CmdStrs(&args, $1);
-  push_back_CmdStrs(&args, NULL);
+|       cmd string {
+  push_back_argv(&$1, $2);
 
-  $$ = args;
+  $$ = $1;
 }
 
 
 
 cmd_arguments: string {
-  CmdStrs args = new_CmdStrs(1);
-
-  push_front_CmdStrs(&args, $1);
-  push_back_CmdStrs(&args, NULL);
-
-  $$ = args;
+  $$ = mk_argv($1);
 }
-|       string cmd_arguments {
-  push_front_CmdStrs(&$2, $1);
+|       cmd_arguments string {
+  push_back_argv(&$1, $2);
 
-  $$ = $2;
+  $$ = $1;
 }
 
 
@@ -297,7 +286,7 @@ special_string: ECHO_TOK {
 }
 
 first_string: STR {
-  $$ = interpret_complex_string_token($1);
+  $$ = interpret_complex_string_token(parser, $1);
 }
 |       SIM_STR {
   $$ = $1;
@@ -311,6 +300,8 @@ first_string: STR {
 
 %%
 
-void yyerror(CommandHolder** cmds, char *str) {
-  fprintf(stderr, "%s: Line %d\n", str, yylineno);
+static void yyerror(yyscan_t scanner, quash_parser_t* parser,
+                    CommandHolder** __ret_cmds, const char* str) {
+  if (!quash_parser_is_quiet(parser))
+    fprintf(stderr, "%s: Line %d\n", str, yyget_lineno(scanner));
 }
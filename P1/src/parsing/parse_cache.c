@@ -0,0 +1,351 @@
+#include "parse_cache.h"
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash_table.h"
+
+/**
+ * @brief Identifies a cached line
+ */
+typedef struct ParseKey {
+  const char* line;         /**< Raw bytes of the line */
+  size_t len;               /**< Length of @a line */
+  unsigned long generation; /**< Environment generation the line was parsed
+                             * under */
+} ParseKey;
+
+/**
+ * @brief A cached line and its commands, allocated as a single block
+ *
+ * The block holds the entry followed by the @a CommandHolder array, the
+ * argument arrays, and finally the strings the commands point to and the line
+ * itself.
+ */
+typedef struct ParseEntry {
+  ParseKey key;             /**< Key of the entry, points into the block */
+  CommandHolder* holders;   /**< The commands, points into the block */
+  struct ParseEntry* prev;  /**< More recently used neighbour */
+  struct ParseEntry* next;  /**< Less recently used neighbour */
+} ParseEntry;
+
+static size_t __hash_parse_key(ParseKey key) {
+  return hash_bytes(key.line, key.len) ^ hash_int((int) key.generation);
+}
+
+static bool __equal_parse_key(ParseKey a, ParseKey b) {
+  return a.len == b.len && a.generation == b.generation &&
+    memcmp(a.line, b.line, a.len) == 0;
+}
+
+IMPLEMENT_HASH_TABLE_STRUCT(ParseIndex, ParseKey, ParseEntry*);
+IMPLEMENT_HASH_TABLE(ParseIndex, ParseKey, ParseEntry*, __hash_parse_key,
+                     __equal_parse_key);
+
+// Lines in the cache
+static ParseIndex __index = { NULL, 0, 0, NULL };
+
+// Most and least recently used entries
+static ParseEntry* __first = NULL;
+static ParseEntry* __last = NULL;
+
+static size_t __capacity = 0;
+static size_t __hits = 0;
+static size_t __misses = 0;
+
+/**
+ * @brief Cursor into the block of an entry
+ *
+ * Copying runs twice. The first pass only measures the block by running with
+ * @a base set to NULL.
+ */
+typedef struct BlockCursor {
+  char* base;  /**< Start of the block or NULL while measuring */
+  size_t size; /**< Bytes used so far */
+} BlockCursor;
+
+// Reserve bytes in the block. Returns NULL while measuring.
+static void* __block_take(BlockCursor* cur, size_t size) {
+  void* ret = (cur->base != NULL) ? cur->base + cur->size : NULL;
+
+  cur->size += size;
+
+  return ret;
+}
+
+static char* __block_strdup(BlockCursor* cur, const char* str) {
+  if (str == NULL)
+    return NULL;
+
+  size_t len = strlen(str) + 1;
+  char* ret = __block_take(cur, len);
+
+  if (ret != NULL)
+    memcpy(ret, str, len);
+
+  return ret;
+}
+
+// Copy a NULL terminated argument array. Only the array is placed here. Its
+// strings are copied by __block_strdup_args() once every array is in place so
+// the arrays stay pointer aligned.
+static char** __block_take_args(BlockCursor* cur, char** args) {
+  size_t count = 0;
+
+  while (args[count] != NULL)
+    ++count;
+
+  return __block_take(cur, (count + 1) * sizeof(char*));
+}
+
+static void __block_strdup_args(BlockCursor* cur, char** dst, char** args) {
+  size_t i;
+
+  for (i = 0; args[i] != NULL; ++i) {
+    char* str = __block_strdup(cur, args[i]);
+
+    if (dst != NULL)
+      dst[i] = str;
+  }
+
+  if (dst != NULL)
+    dst[i] = NULL;
+}
+
+// Get the argument array of the commands that have one
+static char** __command_args(Command cmd) {
+  switch (get_command_type(cmd)) {
+  case GENERIC:
+  case ECHO:
+  case HASH:
+  case PARSE_CACHE:
+  case SOURCE:
+    return cmd.generic.args;
+
+  default:
+    return NULL;
+  }
+}
+
+// Copy the commands and the line into block. When block is NULL this only
+// measures how large the block has to be.
+static size_t __copy_entry(char* block, const char* line, size_t len,
+                           const CommandHolder* holders) {
+  BlockCursor cur = { block, 0 };
+  size_t count = 0;
+
+  while (get_command_holder_type(holders[count]) != EOC)
+    ++count;
+
+  ParseEntry* entry = __block_take(&cur, sizeof(ParseEntry));
+  CommandHolder* copy = __block_take(&cur, (count + 1) * sizeof(CommandHolder));
+
+  if (copy != NULL) {
+    memcpy(copy, holders, (count + 1) * sizeof(CommandHolder));
+    entry->holders = copy;
+  }
+
+  // Argument arrays first while the cursor is still pointer aligned
+  for (size_t i = 0; i < count; ++i) {
+    char** args = __command_args(holders[i].cmd);
+
+    if (args != NULL) {
+      char** dst = __block_take_args(&cur, args);
+
+      if (copy != NULL)
+        copy[i].cmd.generic.args = dst;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    CommandHolder src = holders[i];
+    CommandHolder* dst = (copy != NULL) ? &copy[i] : NULL;
+    char** args = __command_args(src.cmd);
+    char* in = (src.flags & REDIRECT_IN) ? __block_strdup(&cur, src.redirect_in) : NULL;
+    char* out = (src.flags & REDIRECT_OUT) ? __block_strdup(&cur, src.redirect_out) : NULL;
+
+    if (dst != NULL) {
+      dst->redirect_in = in;
+      dst->redirect_out = out;
+    }
+
+    if (args != NULL) {
+      __block_strdup_args(&cur, (dst != NULL) ? dst->cmd.generic.args : NULL, args);
+      continue;
+    }
+
+    switch (get_command_type(src.cmd)) {
+    case EXPORT: {
+      char* env_var = __block_strdup(&cur, src.cmd.export.env_var);
+      char* val = __block_strdup(&cur, src.cmd.export.val);
+
+      if (dst != NULL) {
+        dst->cmd.export.env_var = env_var;
+        dst->cmd.export.val = val;
+      }
+      break;
+    }
+
+    case CD: {
+      char* dir = __block_strdup(&cur, src.cmd.cd.dir);
+
+      if (dst != NULL)
+        dst->cmd.cd.dir = dir;
+      break;
+    }
+
+    case KILL: {
+      char* sig_str = __block_strdup(&cur, src.cmd.kill.sig_str);
+      char* job_str = __block_strdup(&cur, src.cmd.kill.job_str);
+
+      if (dst != NULL) {
+        dst->cmd.kill.sig_str = sig_str;
+        dst->cmd.kill.job_str = job_str;
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+
+  char* key = __block_take(&cur, len);
+
+  if (key != NULL) {
+    memcpy(key, line, len);
+    entry->key = (ParseKey) { key, len, 0 };
+  }
+
+  return cur.size;
+}
+
+// Unlink an entry from the recently used list
+static void __unlink_entry(ParseEntry* entry) {
+  if (entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    __first = entry->next;
+
+  if (entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    __last = entry->prev;
+}
+
+// Make an entry the most recently used one
+static void __push_entry(ParseEntry* entry) {
+  entry->prev = NULL;
+  entry->next = __first;
+
+  if (__first != NULL)
+    __first->prev = entry;
+  else
+    __last = entry;
+
+  __first = entry;
+}
+
+void initialize_parse_cache(size_t capacity) {
+  assert(capacity > 0);
+
+  __capacity = capacity;
+  __index = new_ParseIndex(capacity);
+}
+
+void clear_parse_cache() {
+  empty_ParseIndex(&__index);
+
+  while (__first != NULL) {
+    ParseEntry* entry = __first;
+
+    __first = entry->next;
+    free(entry);
+  }
+
+  __last = NULL;
+}
+
+void destroy_parse_cache() {
+  if (__index.entries == NULL)
+    return;
+
+  clear_parse_cache();
+  destroy_ParseIndex(&__index);
+}
+
+CommandHolder* lookup_parse_cache(const char* line, size_t len,
+                                  unsigned long generation) {
+  ParseEntry** found = lookup_ParseIndex(&__index, (ParseKey) { line, len, generation });
+
+  if (found == NULL) {
+    ++__misses;
+    return NULL;
+  }
+
+  ++__hits;
+
+  ParseEntry* entry = *found;
+
+  if (entry != __first) {
+    __unlink_entry(entry);
+    __push_entry(entry);
+  }
+
+  return entry->holders;
+}
+
+void insert_parse_cache(const char* line, size_t len, unsigned long generation,
+                        const CommandHolder* holders) {
+  assert(holders != NULL);
+
+  ParseKey key = { line, len, generation };
+
+  if (lookup_ParseIndex(&__index, key) != NULL)
+    return;
+
+  // The commands run straight out of the entry. A parsecache command could
+  // clear the cache and a sourced script could evict the entry while it runs.
+  for (size_t i = 0; get_command_holder_type(holders[i]) != EOC; ++i) {
+    CommandType type = get_command_holder_type(holders[i]);
+
+    if (type == PARSE_CACHE || type == SOURCE)
+      return;
+  }
+
+  // Make room by evicting the least recently used line
+  if (length_ParseIndex(&__index) >= __capacity) {
+    ParseEntry* victim = __last;
+
+    remove_ParseIndex(&__index, victim->key);
+    __unlink_entry(victim);
+    free(victim);
+  }
+
+  size_t size = __copy_entry(NULL, line, len, holders);
+  ParseEntry* entry = malloc(size);
+
+  if (entry == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate a parse cache entry\n");
+    exit(-1);
+  }
+
+  __copy_entry((char*) entry, line, len, holders);
+  entry->key.generation = generation;
+
+  insert_ParseIndex(&__index, entry->key, entry);
+  __push_entry(entry);
+}
+
+ParseCacheStats get_parse_cache_stats() {
+  return (ParseCacheStats) {
+    __hits,
+    __misses,
+    length_ParseIndex(&__index),
+    __capacity
+  };
+}
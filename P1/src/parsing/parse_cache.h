@@ -0,0 +1,94 @@
+/**
+ * @file parse_cache.h
+ *
+ * @brief A bounded cache of parsed input lines so a line that repeats is only
+ * scanned and parsed once.
+ *
+ * Each cached line is copied together with its parsed @a CommandHolder array
+ * into a single block of its own. Unlike the @a MemoryPool these blocks live
+ * until the line is evicted, so the cached commands must never be changed by
+ * their users.
+ */
+
+#ifndef SRC_PARSING_PARSE_CACHE_H
+#define SRC_PARSING_PARSE_CACHE_H
+
+#include <stddef.h>
+
+#include "command.h"
+
+/**
+ * @brief Number of lines kept in the cache before the least recently used one
+ * is evicted
+ */
+#define PARSE_CACHE_CAPACITY 256
+
+/**
+ * @brief Counters reported by the parsecache builtin
+ */
+typedef struct ParseCacheStats {
+  size_t hits;     /**< Lookups that found a parsed line */
+  size_t misses;   /**< Lookups that had to run the parser */
+  size_t length;   /**< Number of lines in the cache */
+  size_t capacity; /**< Maximum number of lines in the cache */
+} ParseCacheStats;
+
+/**
+ * @brief Create the cache
+ *
+ * @param capacity Maximum number of lines to keep
+ */
+void initialize_parse_cache(size_t capacity);
+
+/**
+ * @brief Free every cached line and the cache itself
+ */
+void destroy_parse_cache();
+
+/**
+ * @brief Forget every cached line. The counters are kept.
+ */
+void clear_parse_cache();
+
+/**
+ * @brief Find the parsed form of a line
+ *
+ * @param line The raw bytes of the line including its newline
+ *
+ * @param len Length of @a line
+ *
+ * @param generation The environment generation the line was parsed under.
+ * Lines that cannot expand variables use 0.
+ *
+ * @return The cached commands or NULL if the line is not in the cache
+ */
+CommandHolder* lookup_parse_cache(const char* line, size_t len,
+                                  unsigned long generation);
+
+/**
+ * @brief Add a parsed line to the cache
+ *
+ * The line and the commands are copied, so both may be freed afterwards. The
+ * least recently used line is evicted if the cache is full. Lines that run
+ * parsecache or source are not added because they could clear or evict their
+ * own entry while it runs.
+ *
+ * @param line The raw bytes of the line including its newline
+ *
+ * @param len Length of @a line
+ *
+ * @param generation The environment generation the line was parsed under
+ *
+ * @param holders The commands parsed from the line
+ */
+void insert_parse_cache(const char* line, size_t len, unsigned long generation,
+                        const CommandHolder* holders);
+
+/**
+ * @brief Get the hit and miss counters of the cache
+ *
+ * @return A copy of the counters
+ */
+ParseCacheStats get_parse_cache_stats();
+
+#endif
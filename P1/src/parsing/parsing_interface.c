@@ -1,37 +1,129 @@
 #include "parsing_interface.h"
 
 #include <ctype.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "memory_pool.h"
 #include "parse.tab.h"
+#include "parse_cache.h"
 
-IMPLEMENT_DEQUE_STRUCT(SizeStack, size_t);
 IMPLEMENT_DEQUE_STRUCT(StrBuilder, char);
-IMPLEMENT_DEQUE_STRUCT(MPStrBuilder, char);
 
-IMPLEMENT_DEQUE(SizeStack, size_t);
-IMPLEMENT_DEQUE(StrBuilder, char);
-IMPLEMENT_DEQUE_MEMORY_POOL(MPStrBuilder, char);
-IMPLEMENT_DEQUE_MEMORY_POOL(CmdStrs, char*);
-IMPLEMENT_DEQUE_MEMORY_POOL(Cmds, CommandHolder);
-
-extern void destroy_lex();
+IMPLEMENT_DEQUE_MEMORY_POOL(StrBuilder, char);
+IMPLEMENT_SMALL_DEQUE_MEMORY_POOL(CmdStrs, char*, 16);
+
+IMPLEMENT_DEQUE_STRUCT(ScriptLines, ScriptLine);
+IMPLEMENT_DEQUE_MEMORY_POOL(ScriptLines, ScriptLine);
+
+extern yyscan_t new_lex();
+extern void destroy_lex(yyscan_t scanner);
+extern void lex_scan_bytes(yyscan_t scanner, const char* bytes, size_t len);
+extern int lex_scan_in_place(yyscan_t scanner, char* buf, size_t size);
+extern void lex_end_scan(yyscan_t scanner);
+extern size_t lex_position(yyscan_t scanner);
+extern int yyget_lineno(yyscan_t scanner);
+extern void yyset_lineno(int lineno, yyscan_t scanner);
+
+/**
+ * @brief Everything a single parse needs
+ */
+struct QuashParser {
+  yyscan_t scanner;       /**< State of the scanner */
+  MemoryPoolArena* arena; /**< Memory the parsed commands are allocated on */
+  bool at_end;            /**< Set when the parser reads the end of its
+                           * input */
+  bool is_dynamic;        /**< Set when the line being parsed expands a
+                           * variable */
+  bool uses_status;       /**< Set when the line being parsed expands $? which
+                           * changes with every command */
+  bool quiet;             /**< Set to keep syntax errors from being reported */
+};
+
+/**
+ * @brief A line of standard input
+ */
+typedef struct InputLine {
+  quash_parser_t* parser;   /**< Parser of the line. The commands parsed from
+                             * the line live on its arena. */
+  char* bytes;              /**< Text of the line followed by room for the
+                             * two NUL bytes the scanner needs */
+  size_t len;               /**< Length of the line */
+  size_t cap;               /**< Capacity of @a bytes */
+  int lineno;               /**< Line number of the start of the line */
+  CommandHolder* holders;   /**< Commands parsed ahead of time */
+  unsigned long generation; /**< Environment generation @a holders were parsed
+                             * under */
+  bool parsed;              /**< Set when @a holders was parsed ahead of
+                             * time */
+  bool pending;             /**< Set when the line holds more commands after
+                             * the last one parsed */
+} InputLine;
+
+// Ring of the lines of standard input. The line that is running is followed
+// by the lines waiting to run and then the line being read.
+static InputLine __lines[PARSE_AHEAD_DEPTH + 2];
+static size_t __current = 0;
+static size_t __waiting = 0;
+
+// Where the line being read is in its quoting
+static bool __in_quotes = false;
+static bool __escaped = false;
+static bool __comment = false;
+
+// Input read ahead of the line being read. When standard in is a regular file
+// this is the whole file mapped into memory.
+static char* __in_buf = NULL;
+static size_t __in_pos = 0;
+static size_t __in_len = 0;
+static bool __in_mapped = false;
+static bool __end_of_input = false;
+
+// Line number of the start of the next line of input
+static int __next_lineno = 1;
+
+// Set once standard in may be read while a job runs
+static bool __parse_ahead = false;
+
+// Copy a NULL terminated argument array onto the strings all at once
+static inline void __stringify_args(char** args, CmdStrs* strs) {
+  size_t count = 0;
+
+  while (args[count] != NULL)
+    ++count;
+
+  push_back_n_CmdStrs(strs, args, count);
+}
 
 // Generate a string based off of a pipable generic command
 static inline void __stringify_generic_cmd(GenericCommand cmd, CmdStrs* strs) {
-  // Extract argument strings
-  for (size_t i = 0; cmd.args[i] != NULL; ++i)
-    push_back_CmdStrs(strs, cmd.args[i]);
+  __stringify_args(cmd.args, strs);
 }
 
 static inline void __stringify_echo_cmd(EchoCommand cmd, CmdStrs* strs) {
   push_back_CmdStrs(strs, memory_pool_strdup("echo"));
+  __stringify_args(cmd.args, strs);
+}
+
+static inline void __stringify_hash_cmd(HashCommand cmd, CmdStrs* strs) {
+  push_back_CmdStrs(strs, memory_pool_strdup("hash"));
+  __stringify_args(cmd.args, strs);
+}
 
-  // Extract argument strings
-  for (size_t i = 0; cmd.args[i] != NULL; ++i)
-    push_back_CmdStrs(strs, cmd.args[i]);
+static inline void __stringify_parse_cache_cmd(ParseCacheCommand cmd, CmdStrs* strs) {
+  push_back_CmdStrs(strs, memory_pool_strdup("parsecache"));
+  __stringify_args(cmd.args, strs);
+}
+
+static inline void __stringify_source_cmd(SourceCommand cmd, CmdStrs* strs) {
+  push_back_CmdStrs(strs, memory_pool_strdup("source"));
+  __stringify_args(cmd.args, strs);
 }
 
 // Generate a string based off the export command
@@ -44,7 +136,9 @@ static void __stringify_export_cmd(ExportCommand cmd, CmdStrs* strs) {
 // Generate a string based off of the cd command
 static void __stringify_cd_cmd(CDCommand cmd, CmdStrs* strs) {
   push_back_CmdStrs(strs, memory_pool_strdup("cd"));
-  push_back_CmdStrs(strs, cmd.dir);
+
+  if (cmd.dir != NULL)
+    push_back_CmdStrs(strs, cmd.dir);
 }
 
 // Generate a string based off of the kill command
@@ -94,6 +188,18 @@ static void __stringify_command(Command cmd, CmdStrs* strs) {
     __stringify_simple_cmd("EXIT", strs);
     break;
 
+  case HASH:
+    __stringify_hash_cmd(cmd.hash, strs);
+    break;
+
+  case PARSE_CACHE:
+    __stringify_parse_cache_cmd(cmd.parse_cache, strs);
+    break;
+
+  case SOURCE:
+    __stringify_source_cmd(cmd.source, strs);
+    break;
+
   default:
     break;
   }
@@ -133,36 +239,27 @@ static void __stringify_script(const CommandHolder* holders, CmdStrs* strs) {
     if (holders[0].flags & BACKGROUND)
       push_back_CmdStrs(strs, memory_pool_strdup("&"));
   }
+}
 
-  push_back_CmdStrs(strs, NULL);
+// Append strings to a string builder each followed by a space
+static void __append_words(StrBuilder* sb, char** strs, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    push_back_n_StrBuilder(sb, strs[i], strlen(strs[i]));
+    push_back_StrBuilder(sb, ' ');
+  }
 }
 
 // Concatenates arrays of strings together to form a single string with each
 // string separated by a space.
-static char* __condense_string_array(char** str_arr) {
-  SizeStack ss = new_SizeStack(10);
-  size_t len = 0;
+static char* __condense_string_array(CmdStrs* strs) {
+  CmdStrsSpan span = as_span_CmdStrs(strs);
+  StrBuilder sb = new_StrBuilder(64);
 
-  for (size_t i = 0; str_arr[i] != NULL; ++i) {
-    size_t size = strlen(str_arr[i]) + 1;
+  __append_words(&sb, span.first, span.first_len);
+  __append_words(&sb, span.second, span.second_len);
+  push_back_StrBuilder(&sb, '\0');
 
-    push_back_SizeStack(&ss, size);
-    len += size;
-  }
-
-  char* ret = (char*) memory_pool_alloc(len + 1);
-  size_t pos = 0;
-
-  for (size_t i = 0; str_arr[i] != NULL; ++i) {
-    strcpy(ret + pos, str_arr[i]);
-    pos += pop_front_SizeStack(&ss);
-    ret[pos - 1] = ' ';
-  }
-
-  ret[pos] = '\0';
-  destroy_SizeStack(&ss);
-
-  return ret;
+  return as_array_StrBuilder(&sb, NULL);
 }
 
 // Helper for __interpret_deref: Checks if the character is a valid first
@@ -177,55 +274,78 @@ static inline bool __is_identifier_char(char c) {
   return isalnum(c) || c == '_';
 }
 
-// Expand an environment variable onto a string
-static void __interpret_deref(MPStrBuilder* bld, const char* str, int* idx) {
+// Expand an environment variable onto the end of the output
+static void __interpret_deref(quash_parser_t* parser, StrBuilder* out,
+                              const char* str, size_t* idx) {
   assert(str != NULL);
   assert(str[*idx] == '$');
-  assert(peek_back_MPStrBuilder(bld) == '$');
 
-  // Remove the dereference symbol at the back of the bld deque
-  pop_back_MPStrBuilder(bld);
+  // Measure the identifier. Since this is intended only as a helper function
+  // we assume that interpret_complex_string token has already noticed a valid
+  // first identifier character after the dereference symbol.
+  size_t start = *idx + 1;
+  size_t end = start + 1;
 
-  StrBuilder tmp = new_StrBuilder(16);
-  char c;
+  while (__is_identifier_char(str[end]))
+    ++end;
 
-  // Extract the identifier characters. Since this is intended only as a helper
-  // function we assume that interpret_complex_string token has already noticed
-  // a valid first identifier character after the dereference symbol.
-  while (__is_identifier_char((c = str[++(*idx)])))
-    push_back_StrBuilder(&tmp, c);
+  // Extract the id string and lookup the environment variable. Short names
+  // stay off the memory pool so the output can keep growing in place.
+  char buf[64];
+  char* id = (end - start < sizeof(buf)) ? buf
+    : (char*) memory_pool_alloc_aligned(end - start + 1, 1);
 
-  // idx increments one too far in the while loop so bring it back down
-  --(*idx);
+  memcpy(id, str + start, end - start);
+  id[end - start] = '\0';
 
-  // Add the null terminator to the string
-  push_back_StrBuilder(&tmp, '\0');
-
-  // Extract the id string and lookup the environment variable
-  char* id = as_array_StrBuilder(&tmp, NULL);
   const char* env_var = lookup_env(id);
 
-  free(id);
+  parser->is_dynamic = true;
 
-  // Append env_var to the string builder
-  if (env_var != NULL) {
-    for (int i = 0; env_var[i] != '\0'; ++i)
-      push_back_MPStrBuilder(bld, env_var[i]);
-  }
+  if (env_var != NULL)
+    push_back_n_StrBuilder(out, env_var, strlen(env_var));
+
+  *idx = end;
+}
+
+// Expand $? onto the end of the output
+static void __interpret_exit_status(quash_parser_t* parser, StrBuilder* out,
+                                    const char* str, size_t* idx) {
+  assert(str[*idx] == '$');
+  assert(str[*idx + 1] == '?');
+
+  char digits[16];
+  int len = snprintf(digits, sizeof(digits), "%d", get_last_exit_status());
+
+  parser->is_dynamic = true;
+  parser->uses_status = true;
+
+  push_back_n_StrBuilder(out, digits, len);
+
+  *idx += 2;
 }
 
 // Cleans up escapes and unescaped single quotes and expands environment
 // variables found in a string
-char* interpret_complex_string_token(const char* str) {
+char* interpret_complex_string_token(quash_parser_t* parser, const char* str) {
+  assert(parser != NULL);
   assert(str != NULL);
 
-  MPStrBuilder bld = new_MPStrBuilder(64);
-  int i;
-  int len = strlen(str);
+  // Expansions aside the output is never longer than the token
+  StrBuilder out = new_StrBuilder(strlen(str) + 1);
+  size_t start = 0;           // Start of the plain text not yet copied
+  size_t i = 0;               // Where to look for the next special character
   bool in_quotes = false;
 
-  for (i = 0; i <= len; ++i) {
-    push_back_MPStrBuilder(&bld, str[i]);
+  while (true) {
+    // Everything up to the next special character is copied as is
+    i += strcspn(str + i, "\\'$");
+
+    if (str[i] == '\0')
+      break;
+
+    size_t skip = 0;          // Bytes of str[i...] left out of the output
+    size_t next = i + 1;      // Where to continue scanning
 
     switch (str[i]) {
     case '\\':                // Remove valid escape characters
@@ -241,12 +361,13 @@ char* interpret_complex_string_token(const char* str) {
         case ';':
         case ' ':
         case '\t':
-          update_back_MPStrBuilder(&bld, str[++i]);
+          skip = 1;
+          next = i + 2;
           break;
 
         case '\n':
-          pop_back_MPStrBuilder(&bld);
-          ++i;
+          skip = 2;
+          next = i + 2;
           break;
 
         default:
@@ -254,32 +375,50 @@ char* interpret_complex_string_token(const char* str) {
         }
       }
       else if (str[i+1] == '\'') {
-        update_back_MPStrBuilder(&bld, '\'');
-        ++i;
+        skip = 1;
+        next = i + 2;
       }
       break;
 
     case '\'':                // Remove single quotes and toggle quote state
       in_quotes = !in_quotes;
-      pop_back_MPStrBuilder(&bld);
+      skip = 1;
       break;
 
     case '$':                 // Try to dereference environment variables
-      if (!in_quotes && __is_first_identifier_char(str[i + 1]))
-        __interpret_deref(&bld, str, &i);
+      if (!in_quotes && (__is_first_identifier_char(str[i + 1]) || str[i + 1] == '?')) {
+        push_back_n_StrBuilder(&out, str + start, i - start);
+
+        if (str[i + 1] == '?')
+          __interpret_exit_status(parser, &out, str, &i);
+        else
+          __interpret_deref(parser, &out, str, &i);
+
+        start = i;
+        continue;
+      }
       break;
 
     default:
       break;
     }
-  }
 
-  // Add a null terminator
-  update_back_MPStrBuilder(&bld, '\0');
+    if (skip > 0) {
+      // Copy the plain text before the bytes being removed
+      push_back_n_StrBuilder(&out, str + start, i - start);
+      start = i + skip;
+    }
+
+    i = next;
+  }
 
   assert(!in_quotes);
 
-  return as_array_MPStrBuilder(&bld, NULL);
+  // The plain text at the end
+  push_back_n_StrBuilder(&out, str + start, i - start);
+  push_back_StrBuilder(&out, '\0');
+
+  return as_array_StrBuilder(&out, NULL);
 }
 
 // Build a Redirect structure
@@ -291,24 +430,657 @@ Redirect mk_redirect(char* in, char* out, bool append) {
   };
 }
 
+// Start an argument list with one argument
+ArgvBuilder mk_argv(char* str) {
+  ArgvBuilder argv = { NULL, NULL, 0 };
+
+  push_back_argv(&argv, str);
+
+  return argv;
+}
+
+// Chain an argument onto the end of the list
+void push_back_argv(ArgvBuilder* argv, char* str) {
+  assert(argv != NULL);
+
+  ArgvNode* node = memory_pool_alloc_aligned(sizeof(ArgvNode), _Alignof(ArgvNode));
+
+  node->str = str;
+  node->next = NULL;
+
+  if (argv->last != NULL)
+    argv->last->next = node;
+  else
+    argv->first = node;
+
+  argv->last = node;
+  ++argv->len;
+}
+
+// Copy the arguments into an array allocated at its final size
+char** as_array_argv(ArgvBuilder argv) {
+  char** ret = memory_pool_alloc_aligned((argv.len + 1) * sizeof(char*), _Alignof(char*));
+  size_t i = 0;
+
+  for (ArgvNode* node = argv.first; node != NULL; node = node->next)
+    ret[i++] = node->str;
+
+  ret[i] = NULL;
+
+  return ret;
+}
+
+// Start a pipeline with one command
+PipelineBuilder mk_pipeline(CommandHolder holder) {
+  PipelineBuilder pipeline = { NULL, NULL, 0 };
+  PipelineNode* node = memory_pool_alloc_aligned(sizeof(PipelineNode), _Alignof(PipelineNode));
+
+  node->holder = holder;
+  node->next = NULL;
+
+  pipeline.first = pipeline.last = node;
+  pipeline.len = 1;
+
+  return pipeline;
+}
+
+// Pipe the last command of the pipeline into another
+void push_back_pipeline(PipelineBuilder* pipeline, CommandHolder holder) {
+  assert(pipeline != NULL);
+  assert(pipeline->last != NULL);
+
+  PipelineNode* node = memory_pool_alloc_aligned(sizeof(PipelineNode), _Alignof(PipelineNode));
+  CommandHolder* prev = &pipeline->last->holder;
+
+  prev->flags = (prev->flags & ~(REDIRECT_APPEND | REDIRECT_OUT)) | PIPE_OUT;
+  holder.flags = (holder.flags & ~REDIRECT_IN) | PIPE_IN;
+
+  node->holder = holder;
+  node->next = NULL;
+
+  pipeline->last->next = node;
+  pipeline->last = node;
+  ++pipeline->len;
+}
+
+// Copy the pipeline into an array allocated at its final size
+CommandHolder* as_array_pipeline(PipelineBuilder pipeline) {
+  CommandHolder* ret = memory_pool_alloc_aligned((pipeline.len + 1) * sizeof(CommandHolder),
+                                                 _Alignof(CommandHolder));
+  size_t i = 0;
+
+  for (PipelineNode* node = pipeline.first; node != NULL; node = node->next)
+    ret[i++] = node->holder;
+
+  ret[i] = mk_command_holder(NULL, NULL, 0, mk_eoc());
+
+  // A command is in the background if the commands it pipes to are
+  while (i-- > 1) {
+    if (ret[i].flags & BACKGROUND)
+      ret[i - 1].flags |= BACKGROUND;
+  }
+
+  return ret;
+}
+
+// Remember that the parser has run out of input
+void reached_end_of_input(quash_parser_t* parser) {
+  parser->at_end = true;
+}
+
+// Build the string form of a parsed line
+char* stringify_commands(const CommandHolder* holders) {
+  CmdStrs strs = new_CmdStrs(0);
+
+  __stringify_script(holders, &strs);
+
+  return __condense_string_array(&strs);
+}
+
+// Create a parser with its own scanner and arena
+quash_parser_t* new_quash_parser(size_t arena_size) {
+  quash_parser_t* parser = malloc(sizeof(quash_parser_t));
+
+  if (parser == NULL || (parser->scanner = new_lex()) == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate a parser\n");
+    exit(-1);
+  }
+
+  parser->arena = new_memory_pool_arena(arena_size);
+  parser->at_end = false;
+  parser->is_dynamic = false;
+  parser->uses_status = false;
+  parser->quiet = false;
+
+  return parser;
+}
+
+void destroy_quash_parser(quash_parser_t* parser) {
+  if (parser == NULL)
+    return;
+
+  destroy_lex(parser->scanner);
+  destroy_memory_pool_arena(parser->arena);
+  free(parser);
+}
+
+void quash_parser_scan_bytes(quash_parser_t* parser, const char* bytes, size_t len) {
+  lex_scan_bytes(parser->scanner, bytes, len);
+  parser->at_end = false;
+}
+
+bool quash_parser_scan_in_place(quash_parser_t* parser, char* buf, size_t size) {
+  parser->at_end = false;
+
+  return lex_scan_in_place(parser->scanner, buf, size);
+}
+
+void quash_parser_end_scan(quash_parser_t* parser) {
+  lex_end_scan(parser->scanner);
+}
+
+// Parse a line with the arena of the parser in place of the memory pool
+int quash_parser_parse(quash_parser_t* parser, CommandHolder** holders) {
+  assert(parser != NULL);
+  assert(holders != NULL);
+
+  MemoryPoolArena* prev = use_memory_pool_arena(parser->arena);
+
+  parser->is_dynamic = false;
+  parser->uses_status = false;
+
+  int ret = yyparse(parser->scanner, parser, holders);
+
+  use_memory_pool_arena(prev);
+
+  return ret;
+}
+
+void quash_parser_set_quiet(quash_parser_t* parser, bool quiet) {
+  parser->quiet = quiet;
+}
+
+bool quash_parser_is_quiet(const quash_parser_t* parser) {
+  return parser->quiet;
+}
+
+bool quash_parser_at_end(const quash_parser_t* parser) {
+  return parser->at_end;
+}
+
+bool quash_parser_is_dynamic(const quash_parser_t* parser) {
+  return parser->is_dynamic;
+}
+
+bool quash_parser_uses_status(const quash_parser_t* parser) {
+  return parser->uses_status;
+}
+
+size_t quash_parser_position(const quash_parser_t* parser) {
+  return lex_position(parser->scanner);
+}
+
+int quash_parser_lineno(const quash_parser_t* parser) {
+  return yyget_lineno(parser->scanner);
+}
+
+void quash_parser_set_lineno(quash_parser_t* parser, int lineno) {
+  yyset_lineno(lineno, parser->scanner);
+}
+
+void reset_quash_parser_arena(quash_parser_t* parser) {
+  reset_memory_pool_arena(parser->arena);
+}
+
+// Get a line of the ring counting from the one that is running
+static inline InputLine* __line_at(size_t i) {
+  return &__lines[(__current + i) % (PARSE_AHEAD_DEPTH + 2)];
+}
+
+// Add bytes to the end of a line
+static void __append_line(InputLine* line, const char* bytes, size_t len) {
+  if (line->len + len + 2 > line->cap) {
+    line->cap = 2 * (line->len + len + 2);
+    line->bytes = realloc(line->bytes, line->cap);
+
+    if (line->bytes == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate the input line\n");
+      exit(-1);
+    }
+  }
+
+  memcpy(line->bytes + line->len, bytes, len);
+  line->len += len;
+}
+
+/**
+ * @brief Map standard in into memory if it is a regular file
+ *
+ * Mapping skips the read() calls and the copy into a buffer. The file offset
+ * is moved to the end so commands that read standard in see the same thing
+ * they would after quash read the whole file.
+ *
+ * @param fd The descriptor to map
+ *
+ * @return True if the input was mapped
+ */
+static bool __map_input(int fd) {
+  struct stat st;
+  off_t offset;
+
+  if (is_tty() || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) ||
+      (offset = lseek(fd, 0, SEEK_CUR)) < 0 || st.st_size <= offset)
+    return false;
+
+  char* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  if (map == MAP_FAILED)
+    return false;
+
+  lseek(fd, st.st_size, SEEK_SET);
+
+  __in_buf = map;
+  __in_pos = offset;
+  __in_len = st.st_size;
+  __in_mapped = true;
+
+  return true;
+}
+
+// Refill the input buffer. A terminal is read a byte at a time so nothing
+// typed ahead is held back from the commands quash runs.
+static bool __fill_input(int fd) {
+  ssize_t n;
+
+  if (__in_buf == NULL && __map_input(fd))
+    return true;
+
+  // A mapped file was there in full from the start
+  if (__in_mapped) {
+    __end_of_input = true;
+    return false;
+  }
+
+  if (__in_buf == NULL && (__in_buf = malloc(INPUT_BUFFER_SIZE)) == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate the input buffer\n");
+    exit(-1);
+  }
+
+  do {
+    n = read(fd, __in_buf, is_tty() ? 1 : INPUT_BUFFER_SIZE);
+  } while (n < 0 && errno == EINTR);
+
+  __in_pos = 0;
+  __in_len = (n > 0) ? n : 0;
+  __end_of_input = n <= 0;
+
+  return n > 0;
+}
+
+/**
+ * @brief Move buffered input into the line being read
+ *
+ * A line goes on past a newline that is escaped or inside single quotes since
+ * the scanner reads those as part of a string. This way a line always holds
+ * whole commands.
+ *
+ * @param line The line being read
+ *
+ * @return True once the line is complete
+ */
+static bool __scan_input(InputLine* line) {
+  size_t start = __in_pos;
+  bool done = false;
+
+  for (; __in_pos < __in_len && !done; ++__in_pos) {
+    char c = __in_buf[__in_pos];
+
+    if (c == '\n') {
+      // A comment always ends at the newline
+      done = __comment || (!__escaped && !__in_quotes);
+      __comment = __escaped = false;
+    }
+    else if (__comment)
+      continue;
+    else if (__escaped)
+      __escaped = false;
+    else if (c == '\\')
+      __escaped = true;
+    else if (c == '\'')
+      __in_quotes = !__in_quotes;
+    else if (c == '#' && !__in_quotes)
+      __comment = true;
+  }
+
+  __append_line(line, __in_buf + start, __in_pos - start);
+
+  return done;
+}
+
+// Count the lines a piece of input spans
+static int __count_newlines(const char* bytes, size_t len) {
+  int count = 0;
+  const char* end = bytes + len;
+
+  while ((bytes = memchr(bytes, '\n', end - bytes)) != NULL) {
+    ++count;
+    ++bytes;
+  }
+
+  return count;
+}
+
+// Queue the line being read behind the other waiting lines and start reading
+// the next one
+static InputLine* __finish_line() {
+  InputLine* line = __line_at(++__waiting);
+
+  if (line->parser == NULL)
+    line->parser = new_quash_parser(1024);
+
+  line->lineno = __next_lineno;
+  line->parsed = false;
+  line->pending = false;
+
+  __next_lineno += __count_newlines(line->bytes, line->len);
+  __in_quotes = __escaped = __comment = false;
+  __line_at(__waiting + 1)->len = 0;
+
+  return line;
+}
+
+/**
+ * @brief Read until a line is waiting behind the one that is running
+ *
+ * Input is read with read() or mapped rather than read with stdio. Children
+ * forked by quash share the file offset of standard in and a stdio buffer
+ * would be synced back to it when they exit.
+ *
+ * @param fd The descriptor to read
+ *
+ * @return False if there is no more input
+ */
+static bool __read_line(int fd) {
+  while (__waiting == 0) {
+    InputLine* line = __line_at(1);
+
+    if (__in_pos < __in_len || (!__end_of_input && __fill_input(fd))) {
+      if (__scan_input(line))
+        __finish_line();
+    }
+    else if (line->len > 0) {
+      // The last line does not end with a newline
+      __finish_line();
+    }
+    else {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// Give a line to its parser. The line is scanned where it is rather than
+// copied into a buffer of the scanner.
+static void __scan_line(InputLine* line) {
+  line->bytes[line->len] = '\0';
+  line->bytes[line->len + 1] = '\0';
+
+  quash_parser_scan_in_place(line->parser, line->bytes, line->len + 2);
+  quash_parser_set_lineno(line->parser, line->lineno);
+}
+
+// Check if a line could change what the lines after it expand to. Lines that
+// have not been parsed could hold anything.
+static bool __changes_env(const InputLine* line) {
+  if (!line->parsed || line->pending)
+    return true;
+
+  for (size_t i = 0; get_command_holder_type(line->holders[i]) != EOC; ++i) {
+    CommandType type = get_command_holder_type(line->holders[i]);
+
+    if (type == CD || type == EXPORT || type == SOURCE)
+      return true;
+  }
+
+  return false;
+}
+
+// Parse a line that is waiting to run
+static void __parse_line_ahead(size_t i) {
+  InputLine* line = __line_at(i);
+  bool expands = memchr(line->bytes, '$', line->len) != NULL;
+
+  // The line that is running only changes the environment before it waits
+  if (expands && __line_at(0)->pending)
+    return;
+
+  for (size_t j = 1; expands && j < i; ++j) {
+    if (__changes_env(__line_at(j)))
+      return;
+  }
+
+  reset_quash_parser_arena(line->parser);
+  __scan_line(line);
+  quash_parser_set_quiet(line->parser, true);
+
+  int status = quash_parser_parse(line->parser, &line->holders);
+
+  quash_parser_set_quiet(line->parser, false);
+
+  if (status != 0 || line->holders == NULL || quash_parser_uses_status(line->parser))
+    return;
+
+  line->generation = expands ? get_env_generation() : 0;
+  line->pending = !quash_parser_at_end(line->parser) &&
+    quash_parser_position(line->parser) < line->len;
+  line->parsed = true;
+}
+
+// Parse the line that is about to run. Lines seen before are taken from the
+// parse cache without running the scanner or the parser.
+static CommandHolder* __parse_line(InputLine* line) {
+  CommandHolder* holders;
+
+  // Only lines that can expand variables depend on the environment
+  unsigned long generation = (memchr(line->bytes, '$', line->len) != NULL)
+    ? get_env_generation() : 0;
+
+  if ((holders = lookup_parse_cache(line->bytes, line->len, generation)) != NULL) {
+    line->parser->at_end = false;
+    line->pending = false;
+    return holders;
+  }
+
+  // Commands parsed ahead of time are only good if nothing they expand changed
+  if (!line->parsed || line->generation != generation) {
+    reset_quash_parser_arena(line->parser);
+    __scan_line(line);
+
+    quash_parser_parse(line->parser, &line->holders);
+
+    line->pending = !quash_parser_at_end(line->parser) &&
+      quash_parser_position(line->parser) < line->len;
+  }
+
+  holders = line->holders;
+  line->parsed = false;
+
+  // Lines that stopped the parser early or depend on $? are not worth keeping
+  if (holders != NULL && !quash_parser_at_end(line->parser) && !line->pending &&
+      !quash_parser_uses_status(line->parser))
+    insert_parse_cache(line->bytes, line->len, generation, holders);
+
+  return holders;
+}
+
 // Parse a command
 CommandHolder* parse(QuashState* state) {
   assert(state != NULL);
 
+  InputLine* line = __line_at(0);
+  CommandHolder* holders = NULL;
+
+  if (line->pending) {
+    // The commands parsed last time have already run
+    reset_quash_parser_arena(line->parser);
+    line->parser->at_end = false;
+
+    quash_parser_parse(line->parser, &holders);
+    line->pending = !quash_parser_at_end(line->parser) &&
+      quash_parser_position(line->parser) < line->len;
+  }
+  else if (__read_line(STDIN_FILENO)) {
+    __current = (__current + 1) % (PARSE_AHEAD_DEPTH + 2);
+    --__waiting;
+
+    line = __line_at(0);
+    holders = __parse_line(line);
+  }
+  else {
+    end_main_loop();
+  }
+
+  state->parsed_holders = holders;
+
+  if (line->parser != NULL && quash_parser_at_end(line->parser))
+    end_main_loop();
+
+  return holders;
+}
+
+void enable_parse_ahead() {
+  __parse_ahead = true;
+}
+
+void disable_parse_ahead() {
+  __parse_ahead = false;
+}
+
+int parse_ahead_fd() {
+  if (!__parse_ahead || __end_of_input || __waiting >= PARSE_AHEAD_DEPTH)
+    return -1;
+
+  return STDIN_FILENO;
+}
+
+// Parse the lines that are waiting to run while a job runs
+void parse_ahead() {
+  if (!__parse_ahead)
+    return;
+
+  while (__waiting < PARSE_AHEAD_DEPTH) {
+    if (__in_pos == __in_len) {
+      struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+
+      // Only read what is already there
+      if (__end_of_input || poll(&pfd, 1, 0) <= 0 || !__fill_input(STDIN_FILENO))
+        break;
+    }
+
+    if (__scan_input(__line_at(__waiting + 1))) {
+      __finish_line();
+      __parse_line_ahead(__waiting);
+    }
+  }
+}
+
+// Parse every line of a script up front
+ScriptLine* parse_script(quash_parser_t* parser, char* script, size_t len,
+                         bool in_place, size_t* count, int* errors) {
+  assert(parser != NULL);
+  assert(script != NULL);
+
+  // The array of lines lives as long as the parsed commands
+  MemoryPoolArena* prev = use_memory_pool_arena(parser->arena);
+  ScriptLines lines = new_ScriptLines(64);
+  size_t offset = 0;
+
+  if (in_place)
+    quash_parser_scan_in_place(parser, script, len + 2);
+  else
+    quash_parser_scan_bytes(parser, script, len);
+
+  quash_parser_set_lineno(parser, 1);
+  *errors = 0;
+
+  while (!quash_parser_at_end(parser)) {
+    ScriptLine line;
+
+    line.lineno = quash_parser_lineno(parser);
+
+    if (quash_parser_parse(parser, &line.holders) != 0)
+      ++*errors;
+
+    line.is_dynamic = quash_parser_is_dynamic(parser);
+    line.offset = offset;
+
+    // The parser stops right after the newline ending a line so the scanner
+    // is at the start of the next one
+    offset = quash_parser_at_end(parser) ? len : quash_parser_position(parser);
+    line.len = offset - line.offset;
+
+    if (line.holders != NULL)
+      push_back_ScriptLines(&lines, line);
+  }
+
+  quash_parser_end_scan(parser);
+
+  *count = length_ScriptLines(&lines);
+
+  ScriptLine* ret = as_array_ScriptLines(&lines, NULL);
+
+  use_memory_pool_arena(prev);
+
+  return ret;
+}
+
+// Parse a line of a script again with the current environment
+CommandHolder* reparse_script_line(QuashState* state, quash_parser_t* parser,
+                                   const char* script, const ScriptLine* line) {
+  assert(state != NULL);
+  assert(parser != NULL);
+  assert(line != NULL);
+
   CommandHolder* holders;
 
-  yyparse(&holders);
+  const char* bytes = script + line->offset;
+  unsigned long generation = get_env_generation();
 
-  if (holders != NULL) {
-    CmdStrs strs = new_CmdStrs(10);
-    __stringify_script(holders, &strs);
-    state->parsed_str = __condense_string_array(as_array_CmdStrs(&strs, NULL));
+  if ((holders = lookup_parse_cache(bytes, line->len, generation)) != NULL) {
+    state->parsed_holders = holders;
+    return holders;
   }
 
+  quash_parser_scan_bytes(parser, bytes, line->len);
+  quash_parser_set_lineno(parser, line->lineno);
+
+  quash_parser_parse(parser, &holders);
+  quash_parser_end_scan(parser);
+
+  if (holders != NULL && !quash_parser_at_end(parser) &&
+      !quash_parser_uses_status(parser))
+    insert_parse_cache(bytes, line->len, generation, holders);
+
+  state->parsed_holders = holders;
+
   return holders;
 }
 
 // Clean up dynamically allocated memory in the parser
 void destroy_parser() {
-  destroy_lex();
+  for (size_t i = 0; i < PARSE_AHEAD_DEPTH + 2; ++i) {
+    free(__lines[i].bytes);
+    destroy_quash_parser(__lines[i].parser);
+    __lines[i] = (InputLine) { 0 };
+  }
+
+  if (__in_mapped)
+    munmap(__in_buf, __in_len);
+  else
+    free(__in_buf);
+
+  __in_buf = NULL;
+  __in_pos = __in_len = 0;
+  __in_mapped = false;
 }
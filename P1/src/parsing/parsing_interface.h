@@ -14,6 +14,42 @@
 #include "deque.h"
 #include "quash.h"
 
+/**
+ * @brief A parser with its own scanner and memory arena
+ *
+ * Parsers do not share any state so several can be used at once, for example
+ * to parse scripts on other threads or to benchmark the parser on its own. A
+ * parser must only be used by one thread at a time. The commands it returns
+ * are allocated on its arena and stay valid until the arena is reset or the
+ * parser is destroyed.
+ *
+ * @note Expanding variables reads the shell variables and the exit status of
+ * the last job so a parse running on another thread must not overlap commands
+ * that change them.
+ *
+ * @sa new_quash_parser(), quash_parser_parse()
+ */
+typedef struct QuashParser quash_parser_t;
+
+/**
+ * @brief Number of lines of standard input that can be parsed ahead of the
+ * line that is running
+ *
+ * @sa parse_ahead()
+ */
+#define PARSE_AHEAD_DEPTH 16
+
+#ifndef INPUT_BUFFER_SIZE
+/**
+ * @brief Size of the buffer standard in is read into when it is not a regular
+ * file
+ *
+ * A regular file is mapped into memory instead. Build with
+ * `make CFLAGS+=-DINPUT_BUFFER_SIZE=<bytes>` to try other sizes.
+ */
+#define INPUT_BUFFER_SIZE (64 * 1024)
+#endif
+
 /**
  * @brief Intermediate parsing structure used to determine the final
  * configuration of the redirects in a command.
@@ -25,27 +61,77 @@ typedef struct Redirect {
                 * to the end of a file rather than truncating it */
 } Redirect;
 
-/** @cond Doxygen_Suppress */
 /**
- * @struct CmdStrs
+ * @brief An argument in an @a ArgvBuilder
+ */
+typedef struct ArgvNode {
+  char* str;             /**< The argument */
+  struct ArgvNode* next; /**< The argument after this one */
+} ArgvNode;
+
+/**
+ * @brief Intermediate parsing structure that collects the arguments of a
+ * command in the order they are parsed
  *
- * @brief Stores strings in a deque
+ * The arguments are chained together on the @a MemoryPool while the command is
+ * parsed and copied once into an array of exactly the right size at the end,
+ * so long argument lists never move.
  *
- * @sa Example
+ * @sa mk_argv(), push_back_argv(), as_array_argv()
+ */
+typedef struct ArgvBuilder {
+  ArgvNode* first; /**< The first argument */
+  ArgvNode* last;  /**< The last argument */
+  size_t len;      /**< Number of arguments */
+} ArgvBuilder;
+
+/**
+ * @brief A command in a @a PipelineBuilder
  */
-IMPLEMENT_DEQUE_STRUCT(CmdStrs, char*);
+typedef struct PipelineNode {
+  CommandHolder holder;      /**< The command */
+  struct PipelineNode* next; /**< The command this one pipes to */
+} PipelineNode;
 
 /**
- * @struct Command
+ * @brief Intermediate parsing structure that collects the commands of a
+ * pipeline in the order they are parsed
  *
- * @brief Stores @a Command union'd structures in a deque
+ * @sa mk_pipeline(), push_back_pipeline(), as_array_pipeline()
+ */
+typedef struct PipelineBuilder {
+  PipelineNode* first; /**< The first command */
+  PipelineNode* last;  /**< The last command */
+  size_t len;          /**< Number of commands */
+} PipelineBuilder;
+
+/**
+ * @brief A line of a script file that was parsed before the script started
+ * running
+ *
+ * @sa parse_script(), reparse_script_line()
+ */
+typedef struct ScriptLine {
+  CommandHolder* holders; /**< The parsed commands or NULL if the line holds no
+                           * commands */
+  size_t offset;          /**< Offset of the line in the script */
+  size_t len;             /**< Length of the line including its newline */
+  int lineno;             /**< Line number of the line in the script */
+  bool is_dynamic;        /**< The line expands variables so it must be parsed
+                           * again right before it runs */
+} ScriptLine;
+
+/** @cond Doxygen_Suppress */
+/**
+ * @struct CmdStrs
+ *
+ * @brief Stores strings in a deque. The words of most commands fit inline.
  *
  * @sa Example
  */
-IMPLEMENT_DEQUE_STRUCT(Cmds, CommandHolder);
+IMPLEMENT_SMALL_DEQUE_STRUCT(CmdStrs, char*, 16);
 
 PROTOTYPE_DEQUE(CmdStrs, char*);
-PROTOTYPE_DEQUE(Cmds, CommandHolder);
 /** @endcond Doxygen_Suppress */
 
 
@@ -70,28 +156,270 @@ PROTOTYPE_DEQUE(Cmds, CommandHolder);
  */
 Redirect mk_redirect(char* in, char* out, bool append);
 
+/**
+ * @brief Start collecting the arguments of a command
+ *
+ * @param str The first argument
+ *
+ * @return A builder holding only @a str
+ *
+ * @sa ArgvBuilder
+ */
+ArgvBuilder mk_argv(char* str);
+
+/**
+ * @brief Add an argument after the ones already collected
+ *
+ * @param argv The builder to add to
+ *
+ * @param str The argument
+ */
+void push_back_argv(ArgvBuilder* argv, char* str);
+
+/**
+ * @brief Copy the collected arguments into an array
+ *
+ * @param argv The builder
+ *
+ * @return A NULL terminated array allocated on the @a MemoryPool
+ */
+char** as_array_argv(ArgvBuilder argv);
+
+/**
+ * @brief Start collecting the commands of a pipeline
+ *
+ * @param holder The first command
+ *
+ * @return A builder holding only @a holder
+ *
+ * @sa PipelineBuilder
+ */
+PipelineBuilder mk_pipeline(CommandHolder holder);
+
+/**
+ * @brief Pipe the output of the last command collected into another command
+ *
+ * The pipe takes the place of the redirect out of the last command and the
+ * redirect in of @a holder.
+ *
+ * @param pipeline The builder to add to
+ *
+ * @param holder The command to pipe to
+ */
+void push_back_pipeline(PipelineBuilder* pipeline, CommandHolder holder);
+
+/**
+ * @brief Copy the collected commands into an array
+ *
+ * A command runs in the background if any command after it in the pipeline
+ * does.
+ *
+ * @param pipeline The builder
+ *
+ * @return An array ended by an @a EOC command allocated on the @a MemoryPool
+ */
+CommandHolder* as_array_pipeline(PipelineBuilder pipeline);
+
 /**
  * @brief Clean up a string by removing escape symbols and unescaped single
  * quotes. Also expands any environment variables.
  *
+ * @param parser The parser the string was read by. It notes whether the string
+ * expanded any variables.
+ *
  * @param str The string to clean up
  *
  * @return The cleaned up and expanded string allocated on the @a MemoryPool
  *
  * @sa MemoryPool
  */
-char* interpret_complex_string_token(const char* str);
+char* interpret_complex_string_token(quash_parser_t* parser, const char* str);
+
+/**
+ * @brief Build the string form of a parsed line such as the one shown for
+ * background jobs
+ *
+ * @param holders The parsed commands
+ *
+ * @return The string allocated on the @a MemoryPool
+ *
+ * @sa get_command_string()
+ */
+char* stringify_commands(const CommandHolder* holders);
+
+/**
+ * @brief Note that the parser has reached the end of its input
+ *
+ * @param parser The parser that reached the end
+ *
+ * @sa quash_parser_at_end()
+ */
+void reached_end_of_input(quash_parser_t* parser);
+
+
+/*************************************************************
+ * Reentrant parser
+ *************************************************************/
+/**
+ * @brief Create a parser
+ *
+ * @param arena_size The initial size of the memory arena of the parser
+ *
+ * @return The new parser
+ *
+ * @sa quash_parser_t, destroy_quash_parser()
+ */
+quash_parser_t* new_quash_parser(size_t arena_size);
+
+/**
+ * @brief Free a parser along with every command it returned
+ *
+ * @param parser The parser to destroy. Nothing is done if it is NULL.
+ */
+void destroy_quash_parser(quash_parser_t* parser);
+
+/**
+ * @brief Make the parser read from a copy of some bytes
+ *
+ * @param parser The parser
+ *
+ * @param bytes The input. It may be read only and is not used after this
+ * returns.
+ *
+ * @param len Length of @a bytes
+ */
+void quash_parser_scan_bytes(quash_parser_t* parser, const char* bytes, size_t len);
+
+/**
+ * @brief Make the parser read a buffer without copying it
+ *
+ * The scanner writes to the buffer while it runs so the buffer must stay
+ * untouched until the parser is given other input.
+ *
+ * @param parser The parser
+ *
+ * @param buf The input followed by two NUL bytes
+ *
+ * @param size Size of @a buf including the two NUL bytes
+ *
+ * @return False if the buffer does not end with two NUL bytes
+ */
+bool quash_parser_scan_in_place(quash_parser_t* parser, char* buf, size_t size);
+
+/**
+ * @brief Release the input given to the parser
+ *
+ * @param parser The parser
+ */
+void quash_parser_end_scan(quash_parser_t* parser);
+
+/**
+ * @brief Parse the next line of the input
+ *
+ * Allocations made while parsing come from the arena of the parser rather
+ * than the memory pool of the calling thread.
+ *
+ * @param parser The parser
+ *
+ * @param[out] holders The parsed commands or NULL if the line was empty or had
+ * a syntax error
+ *
+ * @return Zero on success and non-zero on a syntax error
+ */
+int quash_parser_parse(quash_parser_t* parser, CommandHolder** holders);
+
+/**
+ * @brief Stop the parser from reporting syntax errors
+ *
+ * A line parsed ahead of time is parsed again when it runs if it has errors,
+ * so they are reported in order with the output of the commands before it.
+ *
+ * @param parser The parser
+ *
+ * @param quiet True to keep syntax errors to itself
+ */
+void quash_parser_set_quiet(quash_parser_t* parser, bool quiet);
+
+/**
+ * @brief Check if the parser reports syntax errors
+ *
+ * @param parser The parser
+ *
+ * @return True if syntax errors are not reported
+ */
+bool quash_parser_is_quiet(const quash_parser_t* parser);
+
+/**
+ * @brief Check if the parser has read all of its input
+ *
+ * @param parser The parser
+ *
+ * @return True once the end of the input has been parsed
+ */
+bool quash_parser_at_end(const quash_parser_t* parser);
+
+/**
+ * @brief Check if the last line parsed expanded any variables
+ *
+ * @param parser The parser
+ *
+ * @return True if parsing the line again could give a different result
+ */
+bool quash_parser_is_dynamic(const quash_parser_t* parser);
+
+/**
+ * @brief Check if the last line parsed expanded `$?`
+ *
+ * @param parser The parser
+ *
+ * @return True if the line depends on the exit status of the last job
+ */
+bool quash_parser_uses_status(const quash_parser_t* parser);
+
+/**
+ * @brief Offset of the next byte the parser will read
+ *
+ * @param parser The parser
+ *
+ * @return The offset from the start of the input
+ */
+size_t quash_parser_position(const quash_parser_t* parser);
+
+/**
+ * @brief Get the line number of the next byte the parser will read
+ *
+ * @param parser The parser
+ *
+ * @return The line number or zero if the parser has no input
+ */
+int quash_parser_lineno(const quash_parser_t* parser);
+
+/**
+ * @brief Set the line number reported in syntax errors
+ *
+ * @param parser The parser. It must have been given input.
+ *
+ * @param lineno The line number of the next byte the parser will read
+ */
+void quash_parser_set_lineno(quash_parser_t* parser, int lineno);
+
+/**
+ * @brief Free the commands returned by the parser so its arena can be reused
+ *
+ * @param parser The parser
+ */
+void reset_quash_parser_arena(quash_parser_t* parser);
 
 
 /*************************************************************
  * Functions used by the parser
  *************************************************************/
 /**
- * @brief Handles the call to the parser and provides a string equivalent of the
- * @a Command structure to @a QuashState
+ * @brief Handles the call to the parser and provides the parsed @a Command
+ * structure to @a QuashState
  *
- * @param[out] state The state of the quash shell. The parsed_str member of
- * QuashState is set to the stringified command structure.
+ * @param[out] state The state of the quash shell. The parsed_holders member of
+ * QuashState is set to the parsed command structure.
  *
  * @return A pointer to the parsed command structure
  *
@@ -99,6 +427,90 @@ char* interpret_complex_string_token(const char* str);
  */
 CommandHolder* parse(QuashState* state);
 
+/**
+ * @brief Let @a parse_ahead() read standard input
+ *
+ * Only used when commands are piped into quash. A terminal is never read
+ * ahead of the prompt and script files are parsed up front.
+ */
+void enable_parse_ahead();
+
+/**
+ * @brief Stop @a parse_ahead() from reading standard input
+ *
+ * A forked copy of quash must not take lines meant for quash.
+ */
+void disable_parse_ahead();
+
+/**
+ * @brief Get the descriptor to wait on for input to parse ahead
+ *
+ * @return STDIN_FILENO if there is input left to read and room to parse it
+ * ahead, otherwise -1 which poll() ignores
+ *
+ * @sa parse_ahead()
+ */
+int parse_ahead_fd();
+
+/**
+ * @brief Read and parse lines of standard input that are waiting behind the
+ * line that is running
+ *
+ * This is called while quash waits on a foreground job so parsing overlaps
+ * with the job. It never blocks and stops after @a PARSE_AHEAD_DEPTH lines.
+ * The lines still run in order. A line that expands variables is not parsed
+ * ahead of a cd, export or source command, and lines that expand `$?` or have syntax
+ * errors are parsed again when they run.
+ */
+void parse_ahead();
+
+/**
+ * @brief Parse every line of a script held in memory
+ *
+ * All syntax errors in the script are reported. The results are allocated on
+ * the arena of @a parser so it must not be destroyed while they are used.
+ *
+ * @param parser The parser to use
+ *
+ * @param script The text of the script. If @a in_place is true it is scanned
+ * without making a copy which requires it to be writable and end with two NUL
+ * bytes that are not counted in @a len.
+ *
+ * @param len Length of the script in bytes
+ *
+ * @param in_place True if the script may be scanned in place
+ *
+ * @param[out] count Number of lines in the returned array
+ *
+ * @param[out] errors Number of lines with syntax errors
+ *
+ * @return An array of @a count parsed lines
+ *
+ * @sa ScriptLine, reparse_script_line()
+ */
+ScriptLine* parse_script(quash_parser_t* parser, char* script, size_t len,
+                         bool in_place, size_t* count, int* errors);
+
+/**
+ * @brief Parse a line of a script again so that its variables are expanded
+ * with the current environment
+ *
+ * @param[out] state The state of the quash shell. The parsed_holders member of
+ * QuashState is set to the parsed command structure.
+ *
+ * @param parser The parser given to @a parse_script()
+ *
+ * @param script The same script that was given to @a parse_script()
+ *
+ * @param line The line to parse again
+ *
+ * @return A pointer to the parsed command structure
+ *
+ * @sa ScriptLine, parse_script()
+ */
+CommandHolder* reparse_script_line(QuashState* state, quash_parser_t* parser,
+                                   const char* script, const ScriptLine* line);
+
 /**
  * @brief Cleanup memory dynamically allocated by the parser
  */
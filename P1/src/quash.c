@@ -9,9 +9,15 @@
  **************************************************************************/
 #include "quash.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -19,6 +25,7 @@
 #include "execute.h"
 #include "parsing_interface.h"
 #include "memory_pool.h"
+#include "parse_cache.h"
 
 /**************************************************************************
  * Private Variables
@@ -32,7 +39,9 @@ static QuashState initial_state() {
   return (QuashState) {
     true,
     isatty(STDIN_FILENO),
-    NULL
+    NULL,
+    0,
+    { NULL }
   };
 }
 
@@ -75,6 +84,185 @@ static void print_prompt() {
     free(cwd);
 }
 
+// Wait for the user to type a command. Background jobs that complete in the
+// meantime are reported right away and the prompt is printed again.
+static void wait_for_input() {
+  struct pollfd fds[2] = {
+    { STDIN_FILENO, POLLIN, 0 },
+    { child_reaper_fd(), POLLIN, 0 }
+  };
+
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+
+      return;
+    }
+
+    if ((fds[1].revents & POLLIN) && check_jobs_bg_status())
+      print_prompt();
+
+    if (fds[0].revents != 0)
+      return;
+  }
+}
+
+// Read a script that cannot be mapped, such as a pipe, into a malloc'd buffer
+// followed by the two NUL bytes the scanner needs. Returns NULL if reading
+// fails.
+static char* read_script(int fd, size_t* len) {
+  size_t cap = 4096;
+  size_t used = 0;
+  char* buf = malloc(cap);
+
+  while (buf != NULL) {
+    if (cap - used < 3) {
+      char* bigger = realloc(buf, cap *= 2);
+
+      if (bigger == NULL)
+        break;
+
+      buf = bigger;
+    }
+
+    ssize_t n = read(fd, buf + used, cap - used - 2);
+
+    if (n < 0 && errno == EINTR)
+      continue;
+
+    if (n < 0)
+      break;
+
+    if (n == 0) {
+      buf[used] = buf[used + 1] = '\0';
+      *len = used;
+      return buf;
+    }
+
+    used += n;
+  }
+
+  free(buf);
+
+  return NULL;
+}
+
+/**
+ * @brief Run a script file named on the command line
+ *
+ * A regular file is mapped into memory. Anything else, such as a pipe, is read
+ * into a buffer first. Every line is parsed before anything runs, so all
+ * syntax errors in the file are reported up front and nothing is run if there
+ * are any. The parsed lines share the arena of a parser made for the script.
+ * Lines that expand variables are parsed again right before they run so they
+ * see the effects of the lines before them.
+ *
+ * Every script gets its own parser and memory pool arena so a script run by
+ * the source builtin leaves those of the script that sourced it alone.
+ *
+ * @param path Path to the script file
+ *
+ * @return Exit status for quash
+ */
+static int run_script_file(const char* path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "ERROR: Failed to open script %s: %s\n", path, strerror(errno));
+
+    if (fd >= 0)
+      close(fd);
+    return EXIT_FAILURE;
+  }
+
+  bool mapped = S_ISREG(st.st_mode);
+  size_t len = st.st_size;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  char* script = NULL;
+
+  // The end of the last page reads as zeros. If there is room for the two NUL
+  // bytes the scanner needs, the mapping itself is scanned without a copy.
+  bool in_place = len % page_size != 0 && page_size - len % page_size >= 2;
+  size_t map_len = in_place ? len + 2 : len;
+
+  if (!mapped) {
+    // The size of a pipe or a device says nothing about what it holds
+    script = read_script(fd, &len);
+    in_place = true;
+
+    if (script == NULL) {
+      fprintf(stderr, "ERROR: Failed to read script %s: %s\n", path, strerror(errno));
+      close(fd);
+      return EXIT_FAILURE;
+    }
+  }
+  else if (len > 0) {
+    script = mmap(NULL, map_len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+    if (script == MAP_FAILED) {
+      fprintf(stderr, "ERROR: Failed to read script %s: %s\n", path, strerror(errno));
+      close(fd);
+      return EXIT_FAILURE;
+    }
+  }
+
+  close(fd);
+
+  if (script == NULL)
+    return EXIT_SUCCESS;
+
+  if (len == 0) {
+    free(script);
+    return EXIT_SUCCESS;
+  }
+
+  quash_parser_t* parser = new_quash_parser(2 * len + 1024);
+
+  // The pool is reused by every line
+  MemoryPoolArena* pool = new_memory_pool_arena(1024);
+  MemoryPoolArena* prev_pool = use_memory_pool_arena(pool);
+  const CommandHolder* prev_holders = state.parsed_holders;
+
+  size_t count;
+  int errors;
+  ScriptLine* lines = parse_script(parser, script, len, in_place, &count, &errors);
+  int status = EXIT_SUCCESS;
+
+  if (errors > 0) {
+    fprintf(stderr, "ERROR: %s: %d line%s with syntax errors, nothing was run\n",
+            path, errors, errors == 1 ? "" : "s");
+    status = EXIT_FAILURE;
+  }
+  else {
+    for (size_t i = 0; i < count && is_running(); ++i) {
+      CommandHolder* holders = lines[i].holders;
+
+      state.parsed_holders = holders;
+
+      if (lines[i].is_dynamic)
+        holders = reparse_script_line(&state, parser, script, &lines[i]);
+
+      run_script(holders);
+      reset_memory_pool_arena(pool);
+    }
+  }
+
+  use_memory_pool_arena(prev_pool);
+  destroy_memory_pool_arena(pool);
+  destroy_quash_parser(parser);
+
+  if (mapped)
+    munmap(script, map_len);
+  else
+    free(script);
+
+  state.parsed_holders = prev_holders;
+
+  return status;
+}
+
 /**************************************************************************
  * Public Functions
  **************************************************************************/
@@ -85,7 +273,7 @@ bool is_running() {
 
 // Get a copy of the string
 char* get_command_string() {
-  return strdup(state.parsed_str);
+  return strdup(stringify_commands(state.parsed_holders));
 }
 
 // Check if Quash is receiving input from the command line or not
@@ -98,6 +286,38 @@ void end_main_loop() {
   state.running = false;
 }
 
+// Keep a forked copy of quash away from the input and terminal of quash
+void enter_subshell() {
+  state.is_a_tty = false;
+  disable_parse_ahead();
+}
+
+// Run a script in this process
+int source_script(const char* path) {
+  if (state.source_depth >= MAX_SOURCE_DEPTH) {
+    fprintf(stderr, "ERROR: source: %s: Too many nested scripts\n", path);
+    return EXIT_FAILURE;
+  }
+
+  state.sources[state.source_depth++] = path;
+
+  int status = run_script_file(path);
+
+  state.sources[--state.source_depth] = NULL;
+
+  return (status == EXIT_SUCCESS) ? get_last_exit_status() : status;
+}
+
+int get_source_depth() {
+  return state.source_depth;
+}
+
+const char* get_source_path(int depth) {
+  assert(depth > 0 && depth <= state.source_depth);
+
+  return state.sources[depth - 1];
+}
+
 /**
  * @brief Quash entry point
  *
@@ -109,8 +329,24 @@ void end_main_loop() {
  */
 int main(int argc, char** argv) {
   state = initial_state();
-  initBackgroundJobQueue();
+
+  // Commands come from the script file rather than standard in
+  if (argc > 1)
+    state.is_a_tty = false;
+
+  initJobTable();
+  initPathCache();
+  initVariableTable();
+  initialize_parse_cache(PARSE_CACHE_CAPACITY);
+  init_child_reaper();
   if (is_tty()) {
+    // Nothing may be left in the stdio buffer while waiting on the terminal
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    // Foreground jobs get the terminal. Quash has to be able to take it back
+    // while it is not the foreground process group.
+    signal(SIGTTOU, SIG_IGN);
+
     puts("Welcome to Quash!");
     puts("Type \"exit\" or \"quit\" to quit");
     puts("---------------------------------");
@@ -119,20 +355,35 @@ int main(int argc, char** argv) {
 
   atexit(destroy_parser);
   atexit(destroy_memory_pool);
-  atexit(destroyBackgroundJobQueue);
+  atexit(destroyJobTable);
+  atexit(destroyPathCache);
+  atexit(destroyVariableTable);
+  atexit(destroy_parse_cache);
+  atexit(destroy_child_reaper);
+
+  // The pool is reused by every command
+  initialize_memory_pool(1024);
+
+  if (argc > 1)
+    return run_script_file(argv[1]);
+
+  // Commands piped in are parsed while the job before them runs
+  if (!is_tty())
+    enable_parse_ahead();
 
   // Main execution loop
   while (is_running()) {
-    if (is_tty())
+    if (is_tty()) {
       print_prompt();
+      wait_for_input();
+    }
 
-    initialize_memory_pool(1024);
     CommandHolder* script = parse(&state);
 
     if (script != NULL)
       run_script(script);
 
-    destroy_memory_pool();
+    reset_memory_pool();
   }
 
   return EXIT_SUCCESS;
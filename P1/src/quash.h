@@ -11,8 +11,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "command.h"
 #include "execute.h"
 
+/**
+ * @brief Maximum number of scripts the source builtin can nest
+ */
+#define MAX_SOURCE_DEPTH 64
+
 /**
  * @brief Holds information about the state and environment Quash is running in
  */
@@ -20,8 +26,12 @@ typedef struct QuashState {
   bool running;     /**< Indicates if Quash should keep accept more input */
   bool is_a_tty;    /**< Indicates if the shell is receiving input from a file
                      * or the command line */
-  char* parsed_str; /**< Holds a string representing the parsed structure of the
-                     * command input from the command line */
+  const CommandHolder* parsed_holders; /**< The commands parsed from the
+                                       * current input line. Their string form
+                                       * is only built when asked for. */
+  int source_depth; /**< Number of scripts being run by the source builtin */
+  const char* sources[MAX_SOURCE_DEPTH]; /**< Paths of the scripts being
+                                          * sourced, outermost first */
 } QuashState;
 
 /**
@@ -34,6 +44,9 @@ bool is_tty();
 /**
  * @brief Get a deep copy of the current command string
  *
+ * The string is built from the parsed commands on each call so commands that
+ * never ask for it do not pay for it.
+ *
  * @note The free function must be called on the result eventually
  *
  * @return A copy of the command string
@@ -52,4 +65,43 @@ bool is_running();
  */
 void end_main_loop();
 
+/**
+ * @brief Turn a forked copy of quash into a subshell
+ *
+ * The copy no longer reads ahead of the input of quash or hands the terminal
+ * to its jobs. It is used to run the source builtin in a pipeline or in the
+ * background.
+ */
+void enter_subshell();
+
+/**
+ * @brief Run a script file in the current shell
+ *
+ * The script is parsed and run the same way as a script named on the command
+ * line, so syntax errors keep any of it from running. Its cd and export
+ * commands and its background jobs stay in effect after it finishes.
+ *
+ * @param path Path to the script
+ *
+ * @return The exit status of the last command of the script or 1 if it could
+ * not be run
+ */
+int source_script(const char* path);
+
+/**
+ * @brief Get the number of scripts being run by the source builtin
+ *
+ * @return Zero when no script is being sourced
+ */
+int get_source_depth();
+
+/**
+ * @brief Get the path of a script being sourced
+ *
+ * @param depth Nesting level of the script starting at 1 for the outermost
+ *
+ * @return The path given to the source builtin
+ */
+const char* get_source_path(int depth);
+
 #endif // QUASH_H
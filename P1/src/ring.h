@@ -0,0 +1,323 @@
+/**
+ * @file ring.h
+ *
+ * @brief Bounded lock-free queue generators for handing elements from one
+ * thread or signal handler to another.
+ *
+ * A ring holds at most a fixed number of elements in the structure itself so
+ * pushing and popping never allocate. Nothing blocks: a push to a full ring
+ * and a pop from an empty ring fail right away and the caller decides what to
+ * do. The index written by the producers and the index written by the
+ * consumer are kept on separate cache lines so the two sides do not slow each
+ * other down.
+ *
+ * There are two flavours that share @a PROTOTYPE_RING():
+ * - @a IMPLEMENT_SPSC_RING() for exactly one producer and one consumer
+ * - @a IMPLEMENT_MPSC_RING() for any number of producers and one consumer
+ *
+ * Both only use atomic loads, stores and compare and swap on atomic_size_t.
+ * Where those are lock free, as on x86-64 and ARM, a signal handler may push.
+ */
+
+#ifndef SRC_RING_H
+#define SRC_RING_H
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @def RING_CACHE_LINE
+ *
+ * @brief Size in bytes of a cache line. The parts of a ring written by
+ * different threads are aligned to it.
+ */
+#define RING_CACHE_LINE 64
+
+/**
+ * @def IMPLEMENT_SPSC_RING_STRUCT(struct_name, type, n)
+ *
+ * @brief Generates a ring structure for one producer and one consumer.
+ *
+ * Follow this call with either @a PROTOTYPE_RING() (if in a header file) or @a
+ * IMPLEMENT_SPSC_RING() to generate the functions that correspond to this
+ * structure. The structure fields should not be manually changed at any time.
+ *
+ * Each side also keeps the last index it read from the other side so it only
+ * touches the cache line of the other side when the ring looks full or empty.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The number of elements the ring holds. This must be a power of two.
+ *
+ * @sa PROTOTYPE_RING, IMPLEMENT_SPSC_RING
+ */
+#define IMPLEMENT_SPSC_RING_STRUCT(struct_name, type, n)                \
+  typedef struct struct_name {                                          \
+    _Alignas(RING_CACHE_LINE) atomic_size_t head;                       \
+    size_t tail_cache; /* Owned by the consumer */                      \
+                                                                        \
+    _Alignas(RING_CACHE_LINE) atomic_size_t tail;                       \
+    size_t head_cache; /* Owned by the producer */                      \
+                                                                        \
+    _Alignas(RING_CACHE_LINE) type slots[n];                            \
+  } struct_name;
+
+/**
+ * @def IMPLEMENT_MPSC_RING_STRUCT(struct_name, type, n)
+ *
+ * @brief Generates a ring structure for many producers and one consumer.
+ *
+ * Every slot has a sequence number that tells which lap of the ring it is
+ * ready for, so producers only contend on the index they claim slots with.
+ * Follow this call with either @a PROTOTYPE_RING() or @a
+ * IMPLEMENT_MPSC_RING().
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The number of elements the ring holds. This must be a power of two.
+ *
+ * @sa PROTOTYPE_RING, IMPLEMENT_MPSC_RING
+ */
+#define IMPLEMENT_MPSC_RING_STRUCT(struct_name, type, n)                \
+  typedef struct struct_name##Slot {                                    \
+    atomic_size_t seq;                                                  \
+    type value;                                                         \
+  } struct_name##Slot;                                                  \
+                                                                        \
+  typedef struct struct_name {                                          \
+    _Alignas(RING_CACHE_LINE) atomic_size_t head;                       \
+    _Alignas(RING_CACHE_LINE) atomic_size_t tail;                       \
+    _Alignas(RING_CACHE_LINE) struct_name##Slot slots[n];               \
+  } struct_name;
+
+/**
+ * @def PROTOTYPE_RING(struct_name, type)
+ *
+ * @brief Generates prototypes for functions that manipulate ring structures.
+ *
+ * The generated functions are:
+ * - `void init_##struct_name(struct_name* ring)` empties a ring before first
+ *   use. A ring must not be copied after this.
+ * - `bool is_empty_##struct_name(struct_name* ring)` tells the consumer
+ *   whether a pop would fail right now.
+ * - `bool try_push_##struct_name(struct_name* ring, type element)` adds an
+ *   element at the back and returns false if the ring is full.
+ * - `bool try_pop_##struct_name(struct_name* ring, type* element)` removes
+ *   the element at the front into @a element and returns false if there is
+ *   none.
+ *
+ * Only the consumer may call is_empty and try_pop.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @sa IMPLEMENT_SPSC_RING(), IMPLEMENT_MPSC_RING()
+ */
+#define PROTOTYPE_RING(struct_name, type)                               \
+  void init_##struct_name(struct_name*);                                \
+  bool is_empty_##struct_name(struct_name*);                            \
+  bool try_push_##struct_name(struct_name*, type);                      \
+  bool try_pop_##struct_name(struct_name*, type*);
+
+/**
+ * @def IMPLEMENT_SPSC_RING(struct_name, type, n)
+ *
+ * @brief Generates the functions of a structure generated by @a
+ * IMPLEMENT_SPSC_RING_STRUCT()
+ *
+ * Only one thread or signal handler may push at a time and only one may pop
+ * at a time.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The capacity given to @a IMPLEMENT_SPSC_RING_STRUCT()
+ *
+ * @sa IMPLEMENT_SPSC_RING_STRUCT(), PROTOTYPE_RING()
+ */
+#define IMPLEMENT_SPSC_RING(struct_name, type, n)                       \
+  _Static_assert((n) > 0 && ((n) & ((n) - 1)) == 0,                     \
+                 "The capacity of struct_name must be a power of two"); \
+                                                                        \
+  void init_##struct_name(struct_name* ring) {                          \
+    assert(ring != NULL);                                               \
+                                                                        \
+    atomic_init(&ring->head, 0);                                        \
+    atomic_init(&ring->tail, 0);                                        \
+    ring->head_cache = ring->tail_cache = 0;                            \
+  }                                                                     \
+                                                                        \
+  bool is_empty_##struct_name(struct_name* ring) {                      \
+    assert(ring != NULL);                                               \
+                                                                        \
+    size_t head = atomic_load_explicit(&ring->head,                     \
+                                       memory_order_relaxed);           \
+                                                                        \
+    return head == atomic_load_explicit(&ring->tail,                    \
+                                        memory_order_acquire);          \
+  }                                                                     \
+                                                                        \
+  bool try_push_##struct_name(struct_name* ring, type element) {        \
+    assert(ring != NULL);                                               \
+                                                                        \
+    size_t tail = atomic_load_explicit(&ring->tail,                     \
+                                       memory_order_relaxed);           \
+                                                                        \
+    /* Only read the index of the consumer when the ring looks full */  \
+    if (tail - ring->head_cache == (n)) {                               \
+      ring->head_cache = atomic_load_explicit(&ring->head,              \
+                                              memory_order_acquire);    \
+                                                                        \
+      if (tail - ring->head_cache == (n))                               \
+        return false;                                                   \
+    }                                                                   \
+                                                                        \
+    ring->slots[tail & ((n) - 1)] = element;                            \
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release); \
+                                                                        \
+    return true;                                                        \
+  }                                                                     \
+                                                                        \
+  bool try_pop_##struct_name(struct_name* ring, type* element) {        \
+    assert(ring != NULL);                                               \
+    assert(element != NULL);                                            \
+                                                                        \
+    size_t head = atomic_load_explicit(&ring->head,                     \
+                                       memory_order_relaxed);           \
+                                                                        \
+    /* Only read the index of the producer when the ring looks empty */ \
+    if (head == ring->tail_cache) {                                     \
+      ring->tail_cache = atomic_load_explicit(&ring->tail,              \
+                                              memory_order_acquire);    \
+                                                                        \
+      if (head == ring->tail_cache)                                     \
+        return false;                                                   \
+    }                                                                   \
+                                                                        \
+    *element = ring->slots[head & ((n) - 1)];                           \
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release); \
+                                                                        \
+    return true;                                                        \
+  }
+
+/**
+ * @def IMPLEMENT_MPSC_RING(struct_name, type, n)
+ *
+ * @brief Generates the functions of a structure generated by @a
+ * IMPLEMENT_MPSC_RING_STRUCT()
+ *
+ * Any number of threads and signal handlers may push at once. Only one may
+ * pop at a time.
+ *
+ * @note A producer interrupted between claiming a slot and filling it holds
+ * up the consumer at that slot until it resumes, even if later slots are
+ * already filled.
+ *
+ * @param struct_name The name of the structure
+ *
+ * @param type The name of the type of elements stored in the @a struct_name
+ * structure
+ *
+ * @param n The capacity given to @a IMPLEMENT_MPSC_RING_STRUCT()
+ *
+ * @sa IMPLEMENT_MPSC_RING_STRUCT(), PROTOTYPE_RING()
+ */
+#define IMPLEMENT_MPSC_RING(struct_name, type, n)                       \
+  _Static_assert((n) > 0 && ((n) & ((n) - 1)) == 0,                     \
+                 "The capacity of struct_name must be a power of two"); \
+                                                                        \
+  void init_##struct_name(struct_name* ring) {                          \
+    assert(ring != NULL);                                               \
+                                                                        \
+    atomic_init(&ring->head, 0);                                        \
+    atomic_init(&ring->tail, 0);                                        \
+                                                                        \
+    for (size_t i = 0; i < (n); ++i)                                    \
+      atomic_init(&ring->slots[i].seq, i);                              \
+  }                                                                     \
+                                                                        \
+  bool is_empty_##struct_name(struct_name* ring) {                      \
+    assert(ring != NULL);                                               \
+                                                                        \
+    size_t head = atomic_load_explicit(&ring->head,                     \
+                                       memory_order_relaxed);           \
+    struct_name##Slot* slot = &ring->slots[head & ((n) - 1)];           \
+                                                                        \
+    return atomic_load_explicit(&slot->seq, memory_order_acquire)       \
+      != head + 1;                                                      \
+  }                                                                     \
+                                                                        \
+  bool try_push_##struct_name(struct_name* ring, type element) {        \
+    assert(ring != NULL);                                               \
+                                                                        \
+    size_t tail = atomic_load_explicit(&ring->tail,                     \
+                                       memory_order_relaxed);           \
+    struct_name##Slot* slot;                                            \
+                                                                        \
+    while (true) {                                                      \
+      slot = &ring->slots[tail & ((n) - 1)];                            \
+                                                                        \
+      size_t seq = atomic_load_explicit(&slot->seq,                     \
+                                        memory_order_acquire);          \
+      intptr_t diff = (intptr_t) (seq - tail);                          \
+                                                                        \
+      if (diff == 0) {                                                  \
+        /* The slot is free in this lap. Claim it. */                   \
+        if (atomic_compare_exchange_weak_explicit(                      \
+              &ring->tail, &tail, tail + 1, memory_order_relaxed,       \
+              memory_order_relaxed))                                    \
+          break;                                                        \
+      }                                                                 \
+      else if (diff < 0) {                                              \
+        /* The consumer has not taken the element of the last lap */    \
+        return false;                                                   \
+      }                                                                 \
+      else {                                                            \
+        /* Another producer claimed the slot first */                   \
+        tail = atomic_load_explicit(&ring->tail, memory_order_relaxed); \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    slot->value = element;                                              \
+    atomic_store_explicit(&slot->seq, tail + 1, memory_order_release);  \
+                                                                        \
+    return true;                                                        \
+  }                                                                     \
+                                                                        \
+  bool try_pop_##struct_name(struct_name* ring, type* element) {        \
+    assert(ring != NULL);                                               \
+    assert(element != NULL);                                            \
+                                                                        \
+    size_t head = atomic_load_explicit(&ring->head,                     \
+                                       memory_order_relaxed);           \
+    struct_name##Slot* slot = &ring->slots[head & ((n) - 1)];           \
+                                                                        \
+    /* Empty or claimed by a producer that has not filled it yet */     \
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire)          \
+        != head + 1)                                                    \
+      return false;                                                     \
+                                                                        \
+    *element = slot->value;                                             \
+                                                                        \
+    /* Hand the slot to the producers of the next lap */                \
+    atomic_store_explicit(&slot->seq, head + (n),                       \
+                          memory_order_release);                        \
+    atomic_store_explicit(&ring->head, head + 1, memory_order_relaxed); \
+                                                                        \
+    return true;                                                        \
+  }
+
+#endif
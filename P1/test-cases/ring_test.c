@@ -0,0 +1,233 @@
+/**
+ * @file ring_test.c
+ *
+ * @brief Stress test for the rings generated by ring.h
+ *
+ * Producers and consumers run on separate threads and from a signal handler
+ * while the consumer checks that every element arrives once, intact and in
+ * the order its producer pushed it. Build it with ThreadSanitizer and run it
+ * with `make ring-test`.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "ring.h"
+
+/** @brief An element that shows whether it was torn by a racing write */
+typedef struct Event {
+  long producer;
+  long seq;
+  long check;
+} Event;
+
+#define CAPACITY 64
+#define PRODUCERS 4
+#define EVENTS 200000
+#define SIGNALS 2000
+
+IMPLEMENT_SPSC_RING_STRUCT(EventSpsc, Event, CAPACITY);
+IMPLEMENT_SPSC_RING(EventSpsc, Event, CAPACITY);
+IMPLEMENT_MPSC_RING_STRUCT(EventMpsc, Event, CAPACITY);
+IMPLEMENT_MPSC_RING(EventMpsc, Event, CAPACITY);
+
+static EventSpsc spsc;
+static EventMpsc mpsc;
+
+// Counts the events pushed by the signal handler
+static volatile sig_atomic_t signal_seq = 0;
+
+static void __check(bool cond, const char* msg) {
+  if (!cond) {
+    fprintf(stderr, "ring_test: FAIL: %s\n", msg);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static Event __make_event(long producer, long seq) {
+  return (Event) { producer, seq, producer * 31 + seq };
+}
+
+// Check an event from a consumer and return the sequence number it carries
+static long __check_event(Event ev, long expected_seq) {
+  __check(ev.check == ev.producer * 31 + ev.seq, "torn element");
+  __check(ev.seq == expected_seq, "element out of order");
+  return ev.seq;
+}
+
+// Fill, drain and wrap a ring from a single thread
+#define SINGLE_THREAD_TEST(name, struct_name)                           \
+  static void name() {                                                  \
+    static struct_name ring;                                            \
+    Event ev;                                                           \
+    long next_push = 0;                                                 \
+    long next_pop = 0;                                                  \
+                                                                        \
+    init_##struct_name(&ring);                                          \
+    __check(is_empty_##struct_name(&ring), "new ring is not empty");    \
+    __check(!try_pop_##struct_name(&ring, &ev), "popped from empty");   \
+                                                                        \
+    for (int lap = 0; lap < 10; ++lap) {                                \
+      while (try_push_##struct_name(&ring, __make_event(0, next_push))) \
+        ++next_push;                                                    \
+                                                                        \
+      __check(next_push - next_pop == CAPACITY, "wrong capacity");      \
+                                                                        \
+      for (int i = 0; i < CAPACITY / 2 + lap; ++i) {                    \
+        __check(try_pop_##struct_name(&ring, &ev), "failed to pop");    \
+        __check_event(ev, next_pop++);                                  \
+      }                                                                 \
+    }                                                                   \
+                                                                        \
+    while (try_pop_##struct_name(&ring, &ev))                           \
+      __check_event(ev, next_pop++);                                    \
+                                                                        \
+    __check(next_pop == next_push, "lost elements");                    \
+    __check(is_empty_##struct_name(&ring), "drained ring not empty");   \
+  }
+
+SINGLE_THREAD_TEST(__spsc_single_thread, EventSpsc)
+SINGLE_THREAD_TEST(__mpsc_single_thread, EventMpsc)
+
+static void* __spsc_producer(void* arg) {
+  (void) arg;
+
+  for (long i = 0; i < EVENTS; ++i) {
+    while (!try_push_EventSpsc(&spsc, __make_event(0, i)))
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+// One producer thread and the main thread as the consumer
+static void __spsc_threads() {
+  pthread_t producer;
+  Event ev;
+
+  init_EventSpsc(&spsc);
+  pthread_create(&producer, NULL, __spsc_producer, NULL);
+
+  for (long i = 0; i < EVENTS; ++i) {
+    while (!try_pop_EventSpsc(&spsc, &ev))
+      sched_yield();
+
+    __check_event(ev, i);
+  }
+
+  pthread_join(producer, NULL);
+  __check(is_empty_EventSpsc(&spsc), "extra elements");
+}
+
+static void* __mpsc_producer(void* arg) {
+  long id = (long) arg;
+
+  for (long i = 0; i < EVENTS; ++i) {
+    while (!try_push_EventMpsc(&mpsc, __make_event(id, i)))
+      sched_yield();
+  }
+
+  return NULL;
+}
+
+// Several producer threads and the main thread as the consumer. The elements
+// of each producer must keep their order.
+static void __mpsc_threads() {
+  pthread_t producers[PRODUCERS];
+  long next[PRODUCERS] = { 0 };
+  Event ev;
+
+  init_EventMpsc(&mpsc);
+
+  for (long i = 0; i < PRODUCERS; ++i)
+    pthread_create(&producers[i], NULL, __mpsc_producer, (void*) i);
+
+  for (long i = 0; i < PRODUCERS * (long) EVENTS; ++i) {
+    while (!try_pop_EventMpsc(&mpsc, &ev))
+      sched_yield();
+
+    __check(ev.producer >= 0 && ev.producer < PRODUCERS, "bad producer");
+    next[ev.producer] = __check_event(ev, next[ev.producer]) + 1;
+  }
+
+  for (int i = 0; i < PRODUCERS; ++i)
+    pthread_join(producers[i], NULL);
+
+  __check(is_empty_EventMpsc(&mpsc), "extra elements");
+}
+
+static void __signal_producer(int sig) {
+  (void) sig;
+
+  // An event that finds the ring full is dropped without using up a number
+  if (try_push_EventMpsc(&mpsc, __make_event(PRODUCERS, signal_seq)))
+    signal_seq = signal_seq + 1;
+}
+
+static void* __signal_sender(void* arg) {
+  pthread_t target = *(pthread_t*) arg;
+
+  for (int i = 0; i < SIGNALS; ++i) {
+    pthread_kill(target, SIGUSR1);
+    usleep(10);
+  }
+
+  return NULL;
+}
+
+// A signal handler on the consumer thread pushing alongside a producer thread
+static void __mpsc_signal_handler() {
+  pthread_t self = pthread_self();
+  pthread_t sender;
+  pthread_t producer;
+  long next[PRODUCERS + 1] = { 0 };
+  struct sigaction sa = { 0 };
+  Event ev;
+
+  sa.sa_handler = __signal_producer;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGUSR1, &sa, NULL);
+
+  init_EventMpsc(&mpsc);
+  pthread_create(&producer, NULL, __mpsc_producer, (void*) 0);
+  pthread_create(&sender, NULL, __signal_sender, &self);
+
+  while (next[0] < EVENTS) {
+    if (!try_pop_EventMpsc(&mpsc, &ev)) {
+      sched_yield();
+      continue;
+    }
+
+    __check(ev.producer == 0 || ev.producer == PRODUCERS, "bad producer");
+    next[ev.producer] = __check_event(ev, next[ev.producer]) + 1;
+  }
+
+  pthread_join(producer, NULL);
+  pthread_join(sender, NULL);
+  signal(SIGUSR1, SIG_DFL);
+
+  // Collect the signal events still in the ring
+  while (try_pop_EventMpsc(&mpsc, &ev)) {
+    __check(ev.producer == PRODUCERS, "bad producer");
+    next[PRODUCERS] = __check_event(ev, next[PRODUCERS]) + 1;
+  }
+
+  __check(next[PRODUCERS] == signal_seq, "lost signal events");
+  __check(signal_seq > 0, "no signal was handled");
+}
+
+int main() {
+  __spsc_single_thread();
+  __mpsc_single_thread();
+  __spsc_threads();
+  __mpsc_threads();
+  __mpsc_signal_handler();
+
+  puts("ring_test: ok");
+
+  return EXIT_SUCCESS;
+}